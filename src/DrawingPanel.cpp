@@ -3,7 +3,12 @@
 #include "gl/Shader.h"
 #include <GL/glu.h>
 #include "render/SceneGraph.h"
+#include "render/Sphere.h"
 #include "render/SelectionBuffer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <array>
+#include <chrono>
+#include <cstdio>
 
 // Request a GL canvas with a depth buffer and double buffering
 static int s_gl_attribs[] = { WX_GL_RGBA, WX_GL_DOUBLEBUFFER, WX_GL_DEPTH_SIZE, 24, 0 };
@@ -52,6 +57,19 @@ DrawingPanel::DrawingPanel(wxWindow* parent)
 DrawingPanel::~DrawingPanel()
 {
     delete m_Timer;
+
+    // A running load only posts its result back to this panel
+    if (m_loading.valid())
+    {
+        m_loading.wait();
+    }
+
+    // The render thread finishes its queue and deletes the scene and the
+    // selection buffer while the context is current there. It also holds the
+    // last reference to the staging then, so the models go with them. Only
+    // after the join may the context go.
+    m_staging.reset();
+    m_renderThread.reset();
     delete m_context;
 }
 
@@ -64,41 +82,136 @@ void DrawingPanel::ClearDrawing()
 void DrawingPanel::InitializeOpenGL()
 {
     if (!m_context || !IsShownOnScreen()) return; // Ensure the context exists and the window is fully shown
+    if (m_renderThread) return;
 
-    // Set as the current OpenGL context
-    SetCurrent(*m_context);
+    // From here on the context belongs to the render thread; this thread
+    // must not call SetCurrent again
+    m_staging = std::make_shared<SceneStaging>();
+    SceneGraph::buildScene(*m_staging);
 
-    if (glewInit() != GLEW_OK) 
+    m_renderThread = std::make_unique<RenderThread>(this, m_context);
+    m_renderThread->setFrameCallback([this](const SceneGraph& scene) { OnFrameRendered(scene); });
+    m_renderThread->start(m_width, m_height, m_renderMethod, m_probeRenderMethod, m_staging);
+
+    if (m_probeRenderMethod)
     {
-        std::cerr << "Failed to initialize GLEW" << std::endl;
-        return;
+        m_renderThread->post([this](SceneGraph&, SelectionBuffer&) {
+            RenderMethod method = getRenderMethod();
+            CallAfter([this, method]() { m_renderMethod = method; });
+        });
     }
+    m_renderThread->requestRedraw();
 
-    // Create a simple shared shader program (example). This does not change
-    // existing rendering paths yet — it provides a program you can use for
-    // incremental migration to modern GL.
-    static Shader* s_shader = nullptr;
-    if (!s_shader) {
-        s_shader = Shader::GetDefaultShader();
-        if (s_shader) {
-            std::cerr << "Created simple shader program: " << s_shader << std::endl;
-        }
+    //m_Timer->Start(32); // Approx. 30 FPS
+}
+
+void DrawingPanel::SetRenderMethod(RenderMethod method)
+{
+    m_renderMethod = method;
+    m_probeRenderMethod = false;
+
+    if (m_renderThread)
+    {
+        m_renderThread->post([method](SceneGraph& scene, SelectionBuffer&) { scene.setRenderMethod(method); }, true);
+        m_renderThread->requestRedraw(true);
     }
+}
 
-    m_sceneGraph = std::make_unique<SceneGraph>();
-    m_sceneGraph->init(m_width, m_height);
-    m_sceneGraph->setupViewport(m_width, m_height);
-    m_sceneGraph->buildScene();
+void DrawingPanel::SelectFastestRenderMethod()
+{
+    if (m_renderThread)
+    {
+        m_renderThread->post([this](SceneGraph& scene, SelectionBuffer&) {
+            RenderMethod method = scene.selectFastestRenderMethod(20);
+            CallAfter([this, method]() {
+                m_renderMethod = method;
+                wxFrame* frame = wxDynamicCast(wxGetTopLevelParent(this), wxFrame);
+                if (frame && frame->GetStatusBar())
+                {
+                    frame->SetStatusText(wxString::Format("Fastest render method: %s", renderMethodName(method)), 0);
+                }
+            });
+        });
+        m_renderThread->requestRedraw();
+    }
+}
 
-    GLuint fbo = m_sceneGraph->getFBO();
+void DrawingPanel::PrintRenderStats()
+{
+    if (!m_renderThread) return;
+
+    RenderThread::Stats stats = m_renderThread->getStats();
+    m_renderThread->resetStats();
 
-    // Initialize selection buffer
-    m_selectionBuffer = std::make_unique<SelectionBuffer>();
-    if (!m_selectionBuffer->init(fbo, m_width, m_height)) {
-        std::cerr << "Failed to initialize selection buffer" << std::endl;
+    printf("Render thread: %u frames, %.2f ms average, %.2f ms max\n", stats.frames,
+           stats.frames ? stats.frameMs / stats.frames : 0.0, stats.maxFrameMs);
+    printf("  input to swap: %u frames, %.2f ms average, %.2f ms max, %.2f ms last\n", stats.inputFrames,
+           stats.inputFrames ? stats.latencyMs / stats.inputFrames : 0.0, stats.maxLatencyMs, stats.lastLatencyMs);
+    printf("  UI posts: %u, %.2f us average, %.2f us max\n", stats.posts,
+           stats.posts ? stats.postUs / stats.posts : 0.0, stats.maxPostUs);
+}
+
+void DrawingPanel::LoadGeneratedModel()
+{
+    if (!m_staging || (m_loading.valid() && m_loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+    {
+        printf("A model is still loading\n");
+        return;
     }
 
-    //m_Timer->Start(32); // Approx. 30 FPS
+    unsigned int index = m_loadCount++;
+    m_loading = std::async(std::launch::async, [this, index]() {
+        auto start = std::chrono::steady_clock::now();
+
+        // Mesh, levels of detail, welding and optimization all happen here;
+        // the render thread only uploads the result
+        char name[64];
+        snprintf(name, sizeof(name), "generated_sphere_%u", index);
+        std::shared_ptr<Sphere> sphere = std::make_shared<Sphere>(name, 40.0, 512, 256);
+        sphere->setObjectID(1000 + index);
+        sphere->setColors({ PointDouble3D(0.3, 0.4 + 0.1 * (index % 5), 0.8) });
+        // Smooth and dense, so half the bandwidth is worth the quantization
+        sphere->setVertexFormat(VERTEX_FORMAT_COMPACT16);
+        sphere->prepareGeometry();
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("Generated %s in %.1f ms\n", name, ms);
+
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(540.0f + 80.0f * (index % 2), 60.0f + 90.0f * (index / 2 % 5), 0.0f));
+        CallAfter([this, sphere, transform]() {
+            if (!m_staging || !m_renderThread) return;
+
+            m_staging->addModel(sphere, transform);
+            m_staging->publish();
+            m_renderThread->requestRedraw();
+        });
+    });
+}
+
+void DrawingPanel::CycleTessellation()
+{
+    if (!m_staging || !m_renderThread)
+        return;
+
+    // A procedural sphere has no vertex data, so a new tessellation only
+    // costs a VAO on the render thread
+    static const int SLICES[] = { 8, 16, 32, 64, 128 };
+    int slices = SLICES[m_tessellationStep++ % (sizeof(SLICES) / sizeof(SLICES[0]))];
+
+    std::shared_ptr<Sphere> sphere = std::make_shared<Sphere>("tessellated_sphere", 40.0, slices, slices / 2, true);
+    sphere->setObjectID(2000);
+    sphere->setColors({ PointDouble3D(0.9, 0.6, 0.2) });
+    sphere->prepareGeometry();
+
+    if (m_tessellationModel == 0 || !m_staging->replaceModel(m_tessellationModel, sphere))
+    {
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(100.0f, 460.0f, 0.0f));
+        m_tessellationModel = m_staging->addModel(sphere, transform);
+    }
+    m_staging->publish();
+    m_renderThread->requestRedraw();
+
+    printf("Procedural sphere tessellation %d x %d\n", slices, slices / 2);
 }
 
 void DrawingPanel::OnPaint(wxPaintEvent& event)
@@ -107,17 +220,30 @@ void DrawingPanel::OnPaint(wxPaintEvent& event)
     
     if (!m_context || !IsShownOnScreen()) return;
     
-    SetCurrent(*m_context);
-    
     // Initialize OpenGL if not already done
-    static bool initialized = false;
-    if (!initialized) {
+    if (!m_renderThread) {
         InitializeOpenGL();
-        initialized = true;
     }
 
-    m_sceneGraph->render();
-    SwapBuffers(); // Swap front and back buffers
+    // Drawing and the buffer swap happen on the render thread
+    m_renderThread->requestRedraw();
+}
+
+void DrawingPanel::OnFrameRendered(const SceneGraph& scene)
+{
+    // Report the frustum culling result in the frame's status bar
+    const Bvh::CullStats& stats = scene.getCullStats();
+    wxString text = wxString::Format("%s  Visible: %u  Culled: %u  Triangles: %u  LOD bias: %.2f",
+        renderMethodName(getRenderMethod()), stats.visible, stats.culled, (unsigned)scene.getSubmittedTriangles(), scene.getLodBias());
+
+    // Widgets belong to the UI thread
+    CallAfter([this, text]() {
+        wxFrame* frame = wxDynamicCast(wxGetTopLevelParent(this), wxFrame);
+        if (frame && frame->GetStatusBar())
+        {
+            frame->SetStatusText(text, 1);
+        }
+    });
 }
 
 void DrawingPanel::OnSize(wxSizeEvent& event)
@@ -128,15 +254,10 @@ void DrawingPanel::OnSize(wxSizeEvent& event)
     
     if (m_width > 0 && m_height > 0) 
     {
-		if (m_context && IsShownOnScreen() && m_sceneGraph)
+		// The render thread resizes the viewport and the selection buffer
+		if (m_renderThread)
         {
-            //SetCurrent(*m_context);
-            m_sceneGraph->setupViewport(m_width, m_height);
-            
-            // Resize selection buffer to match viewport
-            if (m_selectionBuffer) {
-                m_selectionBuffer->resize(m_width, m_height);
-            }
+            m_renderThread->resize(m_width, m_height);
         }
         m_needsRedraw = true;
         Refresh();
@@ -148,20 +269,50 @@ void DrawingPanel::OnSize(wxSizeEvent& event)
 void DrawingPanel::OnMouseDown(wxMouseEvent& event)
 {
     wxPoint pos = event.GetPosition();
-    unsigned int objectID = GetObjectAtPosition(pos.x, pos.y);
-    
-    if (objectID > 0)
-    {
-        std::cout << "Selected object ID: " << objectID << " at position (" << pos.x << ", " << pos.y << ")" << std::endl;
-    }
-    else
+    PickObjectAtPosition(pos.x, pos.y, [pos](unsigned int objectID) {
+        if (objectID > 0)
+        {
+            std::cout << "Selected object ID: " << objectID << " at position (" << pos.x << ", " << pos.y << ")" << std::endl;
+        }
+        else
+        {
+            std::cout << "No object selected at position (" << pos.x << ", " << pos.y << ")" << std::endl;
+        }
+    });
+}
+
+void DrawingPanel::OnMouseMove(wxMouseEvent& event)
+{
+    m_hoverPos = event.GetPosition();
+    if (m_hoverPicking)
     {
-        std::cout << "No object selected at position (" << pos.x << ", " << pos.y << ")" << std::endl;
+        m_hoverMoved = true;
+        return;
     }
+    PickHover();
 }
 
-void DrawingPanel::OnMouseMove(wxMouseEvent& event)
+void DrawingPanel::PickHover()
 {
+    m_hoverPicking = true;
+    m_hoverMoved = false;
+    PickObjectAtPosition(m_hoverPos.x, m_hoverPos.y, [this](unsigned int objectID) {
+        m_hoverPicking = false;
+        if (objectID != m_hoverID)
+        {
+            m_hoverID = objectID;
+            wxFrame* frame = wxDynamicCast(wxGetTopLevelParent(this), wxFrame);
+            if (frame && frame->GetStatusBar())
+            {
+                frame->SetStatusText(objectID ? wxString::Format("Hover: object %u", objectID) : wxString("Ready"), 0);
+            }
+        }
+
+        if (m_hoverMoved)
+        {
+            PickHover();
+        }
+    });
 }
 
 void DrawingPanel::OnMouseUp(wxMouseEvent& event)
@@ -180,14 +331,10 @@ void DrawingPanel::OnTimer(wxTimerEvent& event)
     angle += 1.0f;
     if (angle >= 360.0f) angle -= 360.0f;
 
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-    glRotatef(angle, 0.0f, 1.0f, 0.0f); // Rotate scene for demonstration
-    
-    GLfloat model[16];
-    glGetFloatv(GL_MODELVIEW_MATRIX, model);
-    glPopMatrix();
+    // Rotate scene for demonstration, on the CPU instead of through the
+    // GL matrix stack and a glGetFloatv readback
+    glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    const GLfloat* model = &rotation[0][0];
 
     float lightPos[3] = { 500.0f, 500.0f, 500.0f };
     for (int i = 0; i < 3; ++i)
@@ -196,45 +343,112 @@ void DrawingPanel::OnTimer(wxTimerEvent& event)
                       model[i * 4 + 2] * lightPos[2] +
                       model[i * 4 + 3] * 1.0f;
     
-    m_sceneGraph->setLight(lightPos);
-
-    Refresh();
+    if (m_renderThread)
+    {
+        std::array<float, 3> light = { { lightPos[0], lightPos[1], lightPos[2] } };
+        m_renderThread->post([light](SceneGraph& scene, SelectionBuffer&) { scene.setLight(light.data()); });
+        m_renderThread->requestRedraw();
+    }
 }
 
-unsigned int DrawingPanel::GetObjectAtPosition(int x, int y)
+void DrawingPanel::PickObjectAtPosition(int x, int y, std::function<void(unsigned int)> callback)
 {
-    if (!m_selectionBuffer || !m_selectionBuffer->isValid()) {
-        return 0;
+    if (!m_renderThread || !m_renderThread->isReady()) {
+        callback(0);
+        return;
     }
-    
-    // Read the object ID from the selection buffer
-    unsigned int objectID = m_selectionBuffer->readObjectID(x, y);
-    
-    return objectID;
+
+    // The read is queued on the render thread, its result comes back there
+    // from SelectionBuffer::pollPicks and is handed over to this thread
+    m_renderThread->post([this, x, y, callback](SceneGraph&, SelectionBuffer& selection) {
+        selection.readObjectIDAsync(x, y, [this, callback](unsigned int objectID) {
+            CallAfter([callback, objectID]() { callback(objectID); });
+        });
+    });
 }
 
 void DrawingPanel::OnKeyDown(wxKeyEvent& event)
 {
     int keyCode = event.GetKeyCode();
     
+    // Everything below touches GL or the scene, which live on the render thread
+    if (!m_renderThread) {
+        event.Skip();
+        return;
+    }
+    
     // Press 'S' to save the selection buffer to file
     if (keyCode == 'S' || keyCode == 's') {
-        if (m_selectionBuffer && m_selectionBuffer->isValid())
-        {
-            // Save to file with timestamp or counter
-            static int counter = 0;
+        // Save to file with timestamp or counter
+        static int counter = 0;
+        int index = counter++;
+        m_renderThread->post([index](SceneGraph&, SelectionBuffer& selection) {
+            if (!selection.isValid()) return;
+
             char filename[256];
-            snprintf(filename, sizeof(filename), "selection_buffer_%03d.ppm", counter++);
+            snprintf(filename, sizeof(filename), "selection_buffer_%03d.ppm", index);
             
-            if (m_selectionBuffer->saveToFile(filename)) {
-                wxLogMessage("Selection buffer saved to: %s", filename);
+            if (selection.saveToFile(filename)) {
+                printf("Selection buffer saved to: %s\n", filename);
             } else {
-                wxLogMessage("Failed to save selection buffer");
+                printf("Failed to save selection buffer\n");
             }
-        }
+        });
+    }
+    
+    // Press '[' / ']' to lower / raise the level of detail quality
+    if (keyCode == '[' || keyCode == ']') {
+        float factor = keyCode == ']' ? 1.25f : 0.8f;
+        m_renderThread->post([factor](SceneGraph& scene, SelectionBuffer&) { scene.setLodBias(scene.getLodBias() * factor); }, true);
+        m_renderThread->requestRedraw(true);
+    }
+    
+    // Press 'I' to compare per-object, instanced and impostor drawing of many spheres
+    if (keyCode == 'I' || keyCode == 'i') {
+        m_renderThread->post([](SceneGraph& scene, SelectionBuffer&) { scene.benchmarkInstancing(20000, 20); });
+        m_renderThread->requestRedraw();
+    }
+    
+    // Press 'M' to toggle GPU culling and multi-draw indirect submission
+    if (keyCode == 'M' || keyCode == 'm') {
+        m_renderThread->post([](SceneGraph& scene, SelectionBuffer&) {
+            bool enabled = scene.setGpuDriven(!scene.isGpuDriven());
+            printf("GPU driven rendering %s\n", enabled ? "on" : "off");
+        }, true);
+        m_renderThread->requestRedraw(true);
+    }
+    
+    // Press 'U' to time uniform uploads by location query, name and handle
+    if (keyCode == 'U' || keyCode == 'u') {
+        m_renderThread->post([](SceneGraph&, SelectionBuffer&) { Shader::benchmarkUniforms(200000); });
+        m_renderThread->requestRedraw();
+    }
+    
+    // Press 'G' to time sphere mesh generation, off the UI thread
+    if (keyCode == 'G' || keyCode == 'g') {
+        m_renderThread->post([](SceneGraph&, SelectionBuffer&) { Sphere::benchmarkBuild(200, 256, 128); });
+    }
+    
+    // Press 'K' to compare synchronous and asynchronous picking per frame
+    if (keyCode == 'K' || keyCode == 'k') {
+        m_renderThread->post([](SceneGraph& scene, SelectionBuffer& selection) { scene.benchmarkPicking(selection, 200); });
+        m_renderThread->requestRedraw();
+    }
+    
+    // Press 'N' to generate and add a large model without stalling the frames
+    if (keyCode == 'N' || keyCode == 'n') {
+        LoadGeneratedModel();
+    }
+    
+    // Press 'T' to step the tessellation of a procedural sphere
+    if (keyCode == 'T' || keyCode == 't') {
+        CycleTessellation();
+    }
+    
+    // Press 'L' to print render thread latency and UI responsiveness
+    if (keyCode == 'L' || keyCode == 'l') {
+        PrintRenderStats();
     }
     
     event.Skip(); // Allow other handlers to process the event
 }
-
-
@@ -7,11 +7,12 @@
 //#include <wx/glutils.h>
 #include <vector>
 #include <memory>
+#include <future>
+#include <functional>
+#include "render/SceneGraph.h"
+#include "RenderThread.h"
 
 
-class SceneGraph;
-class SelectionBuffer;
-
 class DrawingPanel : public wxGLCanvas
 {
 public:
@@ -22,13 +23,50 @@ public:
     void SetDrawingColor(const wxColour& color);
     void ClearDrawing();
     
-    // Selection support
-    unsigned int GetObjectAtPosition(int x, int y);
+    // Selection support. PickObjectAtPosition calls back on the UI thread
+    // once the asynchronous read has finished, usually a frame later; the UI
+    // thread never waits for the render thread or the GPU.
+    void PickObjectAtPosition(int x, int y, std::function<void(unsigned int)> callback);
     void RenderForSelection();
 
+    // Render backend; before the GL initialization this only replaces the
+    // startup probe that otherwise picks the fastest one. Both run on the
+    // render thread, GetRenderMethod reflects them once they have finished.
+    void SetRenderMethod(RenderMethod method);
+    void SelectFastestRenderMethod();
+    RenderMethod GetRenderMethod() const { return m_renderMethod; }
+
+    // Print input-to-photon latency, frame times and the time UI handlers
+    // spent posting to the render thread since the last call
+    void PrintRenderStats();
+
+    // Generate a large model on a background thread and publish it once it
+    // is ready; the frames in between keep drawing the previous snapshot
+    void LoadGeneratedModel();
+
+    // Stage a procedural sphere with the next tessellation in place of the
+    // previous one; published models are replaced, never edited
+    void CycleTessellation();
+
 private:
-    // OpenGL context
+    // OpenGL context, current on the render thread once it has started
     wxGLContext* m_context;
+    std::unique_ptr<RenderThread> m_renderThread;
+
+    // Scene edits are staged here and published to the render thread
+    std::shared_ptr<SceneStaging> m_staging;
+    std::future<void> m_loading;
+    unsigned int m_loadCount = 0;
+    unsigned int m_tessellationModel = 0; // staging id, 0 until the first step
+    unsigned int m_tessellationStep = 0;
+
+    // Hover picking keeps one read in flight; moves in the meantime only
+    // update the position that is picked next
+    bool m_hoverPicking = false;
+    bool m_hoverMoved = false;
+    wxPoint m_hoverPos;
+    unsigned int m_hoverID = 0;
+    void PickHover();
     
     // Event handlers
     void OnPaint(wxPaintEvent& event);
@@ -41,17 +79,20 @@ private:
 
     // Drawing state
     bool m_isDrawing;
-    std::unique_ptr<SceneGraph> m_sceneGraph;
-    std::unique_ptr<SelectionBuffer> m_selectionBuffer;
 
     // OpenGL state
     bool m_needsRedraw;
+    bool m_probeRenderMethod = true;
+    RenderMethod m_renderMethod = RENDER_VAO;
     int m_width, m_height;
 
     wxTimer* m_Timer;
 
-    // OpenGL initialization and rendering
+    // Start the render thread, which initializes OpenGL
     void InitializeOpenGL();
+
+    // Report the frame on the status bar; called on the render thread
+    void OnFrameRendered(const SceneGraph& scene);
     void SetupViewport();
     void RedrawAll();
 
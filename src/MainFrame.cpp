@@ -15,6 +15,9 @@ wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
     EVT_MENU(wxID_SAVE, MainFrame::OnSave)
     EVT_MENU(ID_Hello, MainFrame::OnHello)
     EVT_MENU(ID_ShowDialog, MainFrame::OnShowDialog)
+    EVT_MENU_RANGE(ID_RenderImmediate, ID_RenderVao, MainFrame::OnRenderMethod)
+    EVT_MENU(ID_RenderFastest, MainFrame::OnSelectFastestRenderMethod)
+    EVT_MENU_OPEN(MainFrame::OnMenuOpen)
     EVT_CLOSE(MainFrame::OnClose)
     EVT_TREE_SEL_CHANGED(wxID_ANY, MainFrame::OnTreeItemSelected)
     EVT_LIST_ITEM_SELECTED(wxID_ANY, MainFrame::OnListItemSelected)
@@ -74,6 +77,15 @@ void MainFrame::CreateMenuBar()
     demoMenu->Append(ID_Hello, "&Hello\tCtrl-H", "Show a greeting");
     demoMenu->Append(ID_ShowDialog, "&Show Dialog\tCtrl-D", "Show a sample dialog");
     
+    // Render menu
+    wxMenu* renderMenu = new wxMenu;
+    renderMenu->AppendRadioItem(ID_RenderImmediate, "&Immediate (display lists)", "Draw with display lists");
+    renderMenu->AppendRadioItem(ID_RenderClientArray, "&Client arrays", "Draw from vertex arrays in client memory");
+    renderMenu->AppendRadioItem(ID_RenderVbo, "Vertex &buffers", "Draw from vertex buffer objects");
+    renderMenu->AppendRadioItem(ID_RenderVao, "&Shaders and VAOs", "Draw with shaders and vertex array objects");
+    renderMenu->AppendSeparator();
+    renderMenu->Append(ID_RenderFastest, "Select &fastest", "Time every backend and keep the fastest");
+    
     // Help menu
     wxMenu* helpMenu = new wxMenu;
     helpMenu->Append(wxID_ABOUT, "&About\tF1", "Show about dialog");
@@ -82,6 +94,7 @@ void MainFrame::CreateMenuBar()
     menuBar->Append(fileMenu, "&File");
     menuBar->Append(editMenu, "&Edit");
     menuBar->Append(demoMenu, "&Demo");
+    menuBar->Append(renderMenu, "&Render");
     menuBar->Append(helpMenu, "&Help");
     
     SetMenuBar(menuBar);
@@ -326,6 +339,41 @@ void MainFrame::OnShowDialog(wxCommandEvent& event)
     }
 }
 
+void MainFrame::SetRenderMethod(RenderMethod method)
+{
+    m_drawingPanel->SetRenderMethod(method);
+    UpdateRenderMenu();
+}
+
+void MainFrame::OnRenderMethod(wxCommandEvent& event)
+{
+    SetRenderMethod((RenderMethod)(event.GetId() - ID_RenderImmediate));
+    SetStatusText(wxString::Format("Render method: %s", renderMethodName(m_drawingPanel->GetRenderMethod())), 0);
+}
+
+void MainFrame::OnSelectFastestRenderMethod(wxCommandEvent& event)
+{
+    // Runs on the render thread; the panel reports the result when done
+    m_drawingPanel->SelectFastestRenderMethod();
+    SetStatusText("Timing render methods...", 0);
+}
+
+void MainFrame::OnMenuOpen(wxMenuEvent& event)
+{
+    // The startup probe may have picked another backend since the last update
+    UpdateRenderMenu();
+    event.Skip();
+}
+
+void MainFrame::UpdateRenderMenu()
+{
+    wxMenuBar* menuBar = GetMenuBar();
+    if (menuBar)
+    {
+        menuBar->Check(ID_RenderImmediate + (int)m_drawingPanel->GetRenderMethod(), true);
+    }
+}
+
 void MainFrame::OnClose(wxCloseEvent& event)
 {
     if (event.CanVeto())
@@ -375,4 +423,4 @@ void MainFrame::OnListItemSelected(wxListEvent& event)
         
         m_textCtrl->SetValue(info);
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
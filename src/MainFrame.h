@@ -15,6 +15,9 @@ class MainFrame : public wxFrame
 public:
     MainFrame();
 
+    // Render backend of the drawing view (see DrawingPanel::SetRenderMethod)
+    void SetRenderMethod(RenderMethod method);
+
 private:
     // Event handlers
     void OnExit(wxCommandEvent& event);
@@ -30,6 +33,9 @@ private:
     void OnClearDrawing(wxCommandEvent& event);
     void OnSetPenColor(wxCommandEvent& event);
     void OnSetPenWidth(wxCommandEvent& event);
+    void OnRenderMethod(wxCommandEvent& event);
+    void OnSelectFastestRenderMethod(wxCommandEvent& event);
+    void OnMenuOpen(wxMenuEvent& event);
 
     // Helper methods
     void CreateMenuBar();
@@ -39,6 +45,7 @@ private:
     void CreateDrawingView();
     void PopulateTreeCtrl();
     void PopulateListCtrl();
+    void UpdateRenderMenu();
 
     // Controls
     wxSplitterWindow* m_splitter;
@@ -54,10 +61,15 @@ private:
         ID_ShowDialog = 1001,
         ID_ClearDrawing = 1002,
         ID_SetPenColor = 1003,
-        ID_SetPenWidth = 1004
+        ID_SetPenWidth = 1004,
+        ID_RenderImmediate = 1005, // one per RenderMethod, in enum order
+        ID_RenderClientArray = 1006,
+        ID_RenderVbo = 1007,
+        ID_RenderVao = 1008,
+        ID_RenderFastest = 1009
     };
 
     DECLARE_EVENT_TABLE()
 };
 
-#endif // MAINFRAME_H
\ No newline at end of file
+#endif // MAINFRAME_H
\ No newline at end of file
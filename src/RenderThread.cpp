@@ -0,0 +1,228 @@
+#include <GL/glew.h>
+#include "RenderThread.h"
+#include "gl/Shader.h"
+#include "render/SelectionBuffer.h"
+#include <algorithm>
+#include <cstdio>
+
+RenderThread::RenderThread(wxGLCanvas* canvas, wxGLContext* context)
+    : m_canvas(canvas)
+    , m_context(context)
+    , m_commands(256)
+{
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+}
+
+void RenderThread::start(int width, int height, RenderMethod method, bool probe, std::shared_ptr<SceneStaging> staging)
+{
+    if (m_thread.joinable() || !m_context) return;
+
+    m_thread = std::thread(&RenderThread::threadLoop, this, width, height, method, probe, staging);
+}
+
+void RenderThread::stop()
+{
+    if (!m_thread.joinable()) return;
+
+    Command command;
+    command.type = COMMAND_QUIT;
+    push(std::move(command));
+    m_thread.join();
+}
+
+void RenderThread::requestRedraw(bool input)
+{
+    // Without input to measure, one queued redraw is as good as many
+    if (!input && m_redrawPending.exchange(true)) return;
+
+    Command command;
+    command.type = COMMAND_REDRAW;
+    command.input = input;
+    push(std::move(command));
+}
+
+void RenderThread::resize(int width, int height)
+{
+    Command command;
+    command.type = COMMAND_RESIZE;
+    command.width = width;
+    command.height = height;
+    push(std::move(command));
+}
+
+void RenderThread::post(Job job, bool input)
+{
+    Command command;
+    command.type = COMMAND_JOB;
+    command.job = std::move(job);
+    command.input = input;
+    push(std::move(command));
+}
+
+void RenderThread::push(Command&& command)
+{
+    Clock::time_point start = Clock::now();
+    command.posted = start;
+
+    // The render thread drains the whole queue every frame, so it is only
+    // full when that thread is stuck in a long job; wait for it then
+    while (!m_commands.push(std::move(command)))
+        std::this_thread::yield();
+
+    // Taking the mutex orders the push before the consumer's empty check
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+    }
+    m_wake.notify_one();
+
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats.posts++;
+    m_stats.postUs += us;
+    m_stats.maxPostUs = std::max(m_stats.maxPostUs, us);
+}
+
+RenderThread::Stats RenderThread::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_stats;
+}
+
+void RenderThread::resetStats()
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats = Stats();
+}
+
+void RenderThread::threadLoop(int width, int height, RenderMethod method, bool probe, std::shared_ptr<SceneStaging> staging)
+{
+    m_canvas->SetCurrent(*m_context);
+
+    bool ready = glewInit() == GLEW_OK;
+    if (!ready)
+    {
+        printf("Failed to initialize GLEW\n");
+    }
+    else
+    {
+        Shader::GetDefaultShader();
+
+        m_sceneGraph = std::make_unique<SceneGraph>();
+        m_sceneGraph->init(width, height);
+        m_sceneGraph->setupViewport(width, height);
+        m_sceneGraph->setStaging(staging);
+
+        // Time every backend on this driver unless one was asked for
+        if (probe)
+            m_sceneGraph->selectFastestRenderMethod(20);
+        else
+            m_sceneGraph->setRenderMethod(method);
+
+        m_selectionBuffer = std::make_unique<SelectionBuffer>();
+        if (!m_selectionBuffer->init(m_sceneGraph->getFBO(), width, height))
+        {
+            printf("Failed to initialize selection buffer\n");
+        }
+        m_ready = true;
+    }
+
+    bool running = true;
+    while (running)
+    {
+        {
+            // Asynchronous picks are polled every millisecond until the GPU
+            // has delivered them, even without new commands or frames
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            if (ready && m_selectionBuffer->hasPendingPicks())
+                m_wake.wait_for(lock, std::chrono::milliseconds(1), [this]() { return !m_commands.empty(); });
+            else
+                m_wake.wait(lock, [this]() { return !m_commands.empty(); });
+        }
+
+        bool redraw = false;
+        bool hasInput = false;
+        Clock::time_point firstInput;
+
+        Command command;
+        while (m_commands.pop(command))
+        {
+            if (command.input && !hasInput)
+            {
+                hasInput = true;
+                firstInput = command.posted;
+            }
+
+            switch (command.type)
+            {
+            case COMMAND_REDRAW:
+                m_redrawPending = false;
+                redraw = true;
+                break;
+            case COMMAND_RESIZE:
+                if (ready)
+                {
+                    m_sceneGraph->setupViewport(command.width, command.height);
+                    if (m_selectionBuffer->isValid())
+                        m_selectionBuffer->resize(command.width, command.height);
+                }
+                redraw = true;
+                break;
+            case COMMAND_JOB:
+                // Dropped without a scene; see isReady()
+                if (ready)
+                    command.job(*m_sceneGraph, *m_selectionBuffer);
+                break;
+            case COMMAND_QUIT:
+                running = false;
+                break;
+            }
+        }
+
+        if (running && redraw && ready)
+            renderFrame(hasInput, firstInput);
+
+        if (ready)
+            m_selectionBuffer->pollPicks();
+    }
+
+    // GL objects go while the context is still current on this thread; if
+    // the editors let go of the staging, its models are deleted here too
+    m_ready = false;
+    m_selectionBuffer.reset();
+    m_sceneGraph.reset();
+    staging.reset();
+}
+
+void RenderThread::renderFrame(bool hasInput, Clock::time_point firstInput)
+{
+    Clock::time_point start = Clock::now();
+
+    m_sceneGraph->render();
+    m_canvas->SwapBuffers();
+
+    Clock::time_point end = Clock::now();
+    double frameMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_stats.frames++;
+        m_stats.frameMs += frameMs;
+        m_stats.maxFrameMs = std::max(m_stats.maxFrameMs, frameMs);
+
+        if (hasInput)
+        {
+            double latencyMs = std::chrono::duration<double, std::milli>(end - firstInput).count();
+            m_stats.inputFrames++;
+            m_stats.latencyMs += latencyMs;
+            m_stats.maxLatencyMs = std::max(m_stats.maxLatencyMs, latencyMs);
+            m_stats.lastLatencyMs = latencyMs;
+        }
+    }
+
+    if (m_frameCallback)
+        m_frameCallback(*m_sceneGraph);
+}
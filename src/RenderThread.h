@@ -0,0 +1,146 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <GL/glew.h>
+#include <wx/wx.h>
+#include <wx/glcanvas.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include "render/SceneGraph.h"
+#include "render/SpscQueue.h"
+
+class SelectionBuffer;
+
+/**
+ * Thread that owns the GL context of a canvas and does all of its drawing.
+ *
+ * The UI thread only posts commands (redraw, resize, jobs) into a lock-free
+ * queue and never makes the context current itself. Scene content comes
+ * from snapshots published to a SceneStaging; the SceneGraph and the
+ * SelectionBuffer are created, used and destroyed on the render thread, so
+ * changes to their render settings are posted as jobs. Frames are rendered when the
+ * queue has been drained, so a burst of events costs one frame.
+ *
+ * Handoff: start() is called once the canvas is shown; from then on the
+ * context is current on the render thread only. stop() posts a quit
+ * command and joins; the thread deletes its GL objects before it exits,
+ * after which the owner may delete the context.
+ */
+class RenderThread
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(SceneGraph&, SelectionBuffer&)> Job;
+
+    // Called on the render thread after every presented frame
+    typedef std::function<void(const SceneGraph&)> FrameCallback;
+
+    struct Stats
+    {
+        unsigned int frames = 0;
+        double frameMs = 0.0;       // render and swap, summed over frames
+        double maxFrameMs = 0.0;
+
+        // Posted input to the return of the swap of the frame showing it
+        unsigned int inputFrames = 0;
+        double latencyMs = 0.0;     // summed over inputFrames
+        double maxLatencyMs = 0.0;
+        double lastLatencyMs = 0.0;
+
+        // Time the UI thread spent posting commands
+        unsigned int posts = 0;
+        double postUs = 0.0;        // summed over posts
+        double maxPostUs = 0.0;
+    };
+
+    RenderThread(wxGLCanvas* canvas, wxGLContext* context);
+    ~RenderThread();
+
+    // Create the scene on a new thread, drawing the snapshots published to
+    // staging; probe selects the fastest backend, otherwise method is used.
+    // The thread keeps staging alive until it has released the GL resources
+    // of its models.
+    void start(int width, int height, RenderMethod method, bool probe, std::shared_ptr<SceneStaging> staging);
+
+    // Finish the queued commands, release the GL resources and join
+    void stop();
+
+    bool isRunning() const { return m_thread.joinable(); }
+
+    // True once the scene exists; jobs posted to a thread that failed to
+    // initialize GL are dropped, so wait on call() futures only when ready
+    bool isReady() const { return m_ready; }
+
+    void setFrameCallback(FrameCallback callback) { m_frameCallback = callback; }
+
+    // input marks commands caused by user input, their latency is measured
+    void requestRedraw(bool input = false);
+    void resize(int width, int height);
+    void post(Job job, bool input = false);
+
+    // Run job on the render thread and return its result through a future
+    template <typename F>
+    std::future<typename std::result_of<F(SceneGraph&, SelectionBuffer&)>::type> call(F job, bool input = false)
+    {
+        typedef typename std::result_of<F(SceneGraph&, SelectionBuffer&)>::type Result;
+        std::shared_ptr<std::packaged_task<Result(SceneGraph&, SelectionBuffer&)>> packaged =
+            std::make_shared<std::packaged_task<Result(SceneGraph&, SelectionBuffer&)>>(std::move(job));
+        std::future<Result> future = packaged->get_future();
+        post([packaged](SceneGraph& scene, SelectionBuffer& selection) { (*packaged)(scene, selection); }, input);
+        return future;
+    }
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    enum CommandType
+    {
+        COMMAND_REDRAW,
+        COMMAND_RESIZE,
+        COMMAND_JOB,
+        COMMAND_QUIT
+    };
+
+    struct Command
+    {
+        CommandType type = COMMAND_REDRAW;
+        int width = 0;
+        int height = 0;
+        Job job;
+        bool input = false;
+        Clock::time_point posted;
+    };
+
+    // UI side: enqueue and wake the render thread
+    void push(Command&& command);
+
+    void threadLoop(int width, int height, RenderMethod method, bool probe, std::shared_ptr<SceneStaging> staging);
+    void renderFrame(bool hasInput, Clock::time_point firstInput);
+
+    wxGLCanvas* m_canvas;
+    wxGLContext* m_context;
+    std::thread m_thread;
+
+    SpscQueue<Command> m_commands;
+    std::mutex m_wakeMutex;             // only for sleeping, the queue needs no lock
+    std::condition_variable m_wake;
+    std::atomic<bool> m_redrawPending{ false };
+    std::atomic<bool> m_ready{ false };
+
+    // Owned by the render thread
+    std::unique_ptr<SceneGraph> m_sceneGraph;
+    std::unique_ptr<SelectionBuffer> m_selectionBuffer;
+    FrameCallback m_frameCallback;
+
+    mutable std::mutex m_statsMutex;
+    Stats m_stats;
+};
+
+#endif // RENDERTHREAD_H
@@ -1,5 +1,9 @@
 #include "Shader.h"
 #include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 
 
 static const char* simple_vert = 
@@ -11,15 +15,33 @@ layout(location = 2) in vec3 aColor;
 uniform mat4 mvp;
 uniform mat4 model;
 
+// Vertex decode for the compact formats (see VertexFormat.h)
+uniform vec3 posScale;
+uniform vec3 posOffset;
+uniform float normalScale;
+uniform int octNormals;
+
 out vec3 vNormal;
 out vec3 vColor;
 out vec3 vFragPos;
 
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+
 void main() {
+    vec3 pos = aPos * posScale + posOffset;
+    vec3 normal = octNormals != 0 ? octDecode(aNormal.xy * normalScale) : aNormal;
+
     vColor = vec3(aColor.x, aColor.y, aColor.z);
-    gl_Position = mvp * vec4(aPos, 1.0);
-    vNormal = aNormal;
-    vFragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = mvp * vec4(pos, 1.0);
+    vNormal = normal;
+    vFragPos = vec3(model * vec4(pos, 1.0));
 }
 )GLSL";
 
@@ -58,6 +80,353 @@ void main() {
 }
 )GLSL";
 
+// Instanced variant: one mesh, per-instance offset/scale, color and object ID
+static const char* instanced_vert = 
+R"GLSL(#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 3) in vec4 iOffsetScale;
+layout(location = 4) in vec4 iColor;
+layout(location = 5) in uint iObjectID;
+
+uniform mat4 mvp;
+uniform mat4 model;
+
+// Vertex decode for the compact formats (see VertexFormat.h)
+uniform vec3 posScale;
+uniform vec3 posOffset;
+uniform float normalScale;
+uniform int octNormals;
+
+out vec3 vNormal;
+out vec3 vColor;
+out vec3 vFragPos;
+flat out vec3 vSelectColor;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+
+void main() {
+    vec3 pos = (aPos * posScale + posOffset) * iOffsetScale.w + iOffsetScale.xyz;
+    vec3 normal = octNormals != 0 ? octDecode(aNormal.xy * normalScale) : aNormal;
+
+    // Same encoding as SelectionBuffer::objectIDToColor
+    vSelectColor = vec3(float((iObjectID >> 16) & 0xFFu), float((iObjectID >> 8) & 0xFFu), float(iObjectID & 0xFFu)) / 255.0;
+    vColor = iColor.rgb;
+    gl_Position = mvp * vec4(pos, 1.0);
+    vNormal = normal;
+    vFragPos = vec3(model * vec4(pos, 1.0));
+}
+)GLSL";
+
+static const char* instanced_frag = 
+R"GLSL(#version 330 core
+in vec3 vNormal;
+in vec3 vColor;
+in vec3 vFragPos;
+flat in vec3 vSelectColor;
+
+uniform vec3 viewPos;
+uniform vec3 lightColor;
+uniform vec3 lightPos;
+
+layout(location = 0) out vec4 outScreenColor;
+layout(location = 1) out vec4 outSelectColor;
+
+void main() {
+    vec3 lightDir = normalize(lightPos - vFragPos);
+    float diff = max(dot(normalize(vNormal), lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+    
+    float ambientStrength = 0.3;
+    vec3 ambient = ambientStrength * lightColor;
+
+    float specularStrength = 0.5;
+    vec3 viewDir = normalize(viewPos - vFragPos);
+    vec3 reflectDir = reflect(-lightDir, normalize(vNormal));
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor;
+
+    vec3 result = (diffuse + ambient + specular) * vColor;
+
+    outScreenColor = vec4(result, 1.0);
+    outSelectColor = vec4(vSelectColor, 1.0);
+}
+)GLSL";
+
+// Sphere impostors: one camera facing quad per instance (no vertex buffer,
+// corners from gl_VertexID); the fragment shader ray-casts the exact sphere
+static const char* impostor_vert = 
+R"GLSL(#version 330 core
+layout(location = 3) in vec4 iOffsetScale; // center, radius
+layout(location = 4) in vec4 iColor;
+layout(location = 5) in uint iObjectID;
+
+uniform mat4 mvp;
+uniform mat4 model;
+
+out vec3 vViewPos;
+flat out vec3 vCenter;
+flat out float vRadius;
+flat out vec3 vColor;
+flat out vec3 vSelectColor;
+flat out float vPerspective;
+flat out vec4 vProjRowZ;
+flat out vec4 vProjRowW;
+
+const vec2 corners[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+                                vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main() {
+    // model is the modelview matrix, so this recovers the projection
+    mat4 projection = mvp * inverse(model);
+    bool perspective = abs(projection[2][3]) > 0.5;
+
+    vec3 center = (model * vec4(iOffsetScale.xyz, 1.0)).xyz;
+    float radius = iOffsetScale.w * length(model[0].xyz);
+
+    // Quad through the center, perpendicular to the view ray, just large
+    // enough to cover the silhouette
+    vec3 forward = vec3(0.0, 0.0, -1.0);
+    float halfSize = radius;
+    if (perspective) {
+        float d = length(center);
+        forward = center / max(d, 1e-6);
+        halfSize = d > radius * 1.0001 ? radius * d / sqrt(d * d - radius * radius) : 1e6;
+    }
+    vec3 up = abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    vec3 right = normalize(cross(forward, up));
+    up = cross(right, forward);
+
+    vec2 corner = corners[gl_VertexID];
+    vec3 pos = center + (right * corner.x + up * corner.y) * halfSize;
+
+    vViewPos = pos;
+    vCenter = center;
+    vRadius = radius;
+    vColor = iColor.rgb;
+    // Same encoding as SelectionBuffer::objectIDToColor
+    vSelectColor = vec3(float((iObjectID >> 16) & 0xFFu), float((iObjectID >> 8) & 0xFFu), float(iObjectID & 0xFFu)) / 255.0;
+    vPerspective = perspective ? 1.0 : 0.0;
+    vProjRowZ = vec4(projection[0][2], projection[1][2], projection[2][2], projection[3][2]);
+    vProjRowW = vec4(projection[0][3], projection[1][3], projection[2][3], projection[3][3]);
+    gl_Position = projection * vec4(pos, 1.0);
+}
+)GLSL";
+
+static const char* impostor_frag = 
+R"GLSL(#version 330 core
+in vec3 vViewPos;
+flat in vec3 vCenter;
+flat in float vRadius;
+flat in vec3 vColor;
+flat in vec3 vSelectColor;
+flat in float vPerspective;
+flat in vec4 vProjRowZ;
+flat in vec4 vProjRowW;
+
+uniform vec3 viewPos;
+uniform vec3 lightColor;
+uniform vec3 lightPos;
+
+layout(location = 0) out vec4 outScreenColor;
+layout(location = 1) out vec4 outSelectColor;
+
+void main() {
+    // View ray through this fragment, in view space
+    vec3 origin = vPerspective != 0.0 ? vec3(0.0) : vec3(vViewPos.xy, 0.0);
+    vec3 dir = vPerspective != 0.0 ? normalize(vViewPos) : vec3(0.0, 0.0, -1.0);
+
+    vec3 oc = origin - vCenter;
+    float b = dot(oc, dir);
+    float c = dot(oc, oc) - vRadius * vRadius;
+    float h = b * b - c;
+    if (h < 0.0)
+        discard;
+
+    vec3 fragPos = origin + dir * (-b - sqrt(h));
+    vec3 normal = (fragPos - vCenter) / vRadius;
+
+    float clipZ = dot(vProjRowZ, vec4(fragPos, 1.0));
+    float clipW = dot(vProjRowW, vec4(fragPos, 1.0));
+    float ndcZ = clipZ / clipW;
+    gl_FragDepth = 0.5 * (gl_DepthRange.diff * ndcZ + gl_DepthRange.near + gl_DepthRange.far);
+
+    vec3 lightDir = normalize(lightPos - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+    
+    float ambientStrength = 0.3;
+    vec3 ambient = ambientStrength * lightColor;
+
+    float specularStrength = 0.5;
+    vec3 viewDir = normalize(viewPos - fragPos);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor;
+
+    vec3 result = (diffuse + ambient + specular) * vColor;
+
+    outScreenColor = vec4(result, 1.0);
+    outSelectColor = vec4(vSelectColor, 1.0);
+}
+)GLSL";
+
+// Procedural sphere: no vertex arrays, every vertex is computed from
+// gl_VertexID with the same grid and winding as Sphere::BuildMesh.
+// Used with simple_frag.
+static const char* procedural_sphere_vert = 
+R"GLSL(#version 330 core
+layout(location = 2) in vec3 aColor; // constant attribute, no array bound
+
+uniform mat4 mvp;
+uniform mat4 model;
+uniform vec4 shapeParams; // radius, slices, stacks
+
+out vec3 vNormal;
+out vec3 vColor;
+out vec3 vFragPos;
+
+const float PI = 3.14159265358979;
+
+// Corners (stack, slice) of the two triangles of a quad: v0, v2, v1 and v2, v3, v1
+const ivec2 corners[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0),
+                                  ivec2(0, 1), ivec2(1, 1), ivec2(1, 0));
+
+void main() {
+    int slices = int(shapeParams.y);
+    int quad = gl_VertexID / 6;
+    ivec2 corner = corners[gl_VertexID % 6];
+    int i = quad / slices + corner.x;
+    int j = quad % slices + corner.y;
+
+    float phi = PI * (float(i) / shapeParams.z - 0.5);
+    float theta = 2.0 * PI * float(j) / float(slices);
+    vec3 normal = vec3(cos(phi) * cos(theta), sin(phi), cos(phi) * sin(theta));
+    vec3 pos = normal * shapeParams.x;
+
+    vColor = aColor;
+    gl_Position = mvp * vec4(pos, 1.0);
+    vNormal = normal;
+    vFragPos = vec3(model * vec4(pos, 1.0));
+}
+)GLSL";
+
+// Per-object data from a buffer texture (see ObjectDataBuffer), selected by
+// attribute 3: a constant set per draw by RenderQueue, or a per-instance
+// array that each indirect command's baseInstance points into on the
+// GpuDrivenRenderer path. Used with instanced_frag.
+static const char* object_data_vert = 
+R"GLSL(#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec3 aColor;
+layout(location = 3) in uint aObjectIndex;
+
+uniform mat4 viewProjection;
+uniform mat4 view;
+uniform samplerBuffer objectData;
+
+out vec3 vNormal;
+out vec3 vColor;
+out vec3 vFragPos;
+flat out vec3 vSelectColor;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+
+void main() {
+    // world matrix, posScale + normalScale, posOffset + octNormals, color + object ID, hasColors
+    int base = int(aObjectIndex) * 8;
+    mat4 world = mat4(texelFetch(objectData, base), texelFetch(objectData, base + 1),
+                      texelFetch(objectData, base + 2), texelFetch(objectData, base + 3));
+    vec4 posScale = texelFetch(objectData, base + 4);
+    vec4 posOffset = texelFetch(objectData, base + 5);
+    vec4 color = texelFetch(objectData, base + 6);
+    vec4 flags = texelFetch(objectData, base + 7);
+
+    vec3 pos = aPos * posScale.xyz + posOffset.xyz;
+    vec3 normal = posOffset.w != 0.0 ? octDecode(aNormal.xy * posScale.w) : aNormal;
+
+    // Same encoding as SelectionBuffer::objectIDToColor
+    uint objectID = uint(color.w);
+    vSelectColor = vec3(float((objectID >> 16) & 0xFFu), float((objectID >> 8) & 0xFFu), float(objectID & 0xFFu)) / 255.0;
+    vColor = flags.x != 0.0 ? aColor : color.rgb;
+
+    vec4 worldPos = world * vec4(pos, 1.0);
+    gl_Position = viewProjection * worldPos;
+    vNormal = normal;
+    vFragPos = vec3(view * worldPos);
+}
+)GLSL";
+
+// Frustum culling by transform feedback: one point per object. With
+// keepCulled the geometry shader emits a command for every object, with
+// instanceCount 0 for the culled ones; otherwise only the visible ones,
+// which compacts the command buffer
+static const char* cull_vert = 
+R"GLSL(#version 330 core
+layout(location = 0) in vec3 aBoundsMin;
+layout(location = 1) in vec3 aBoundsMax;
+layout(location = 2) in uvec4 aCommand; // count, firstIndex, baseVertex, object index
+
+out vec3 vBoundsMin;
+out vec3 vBoundsMax;
+flat out uvec4 vCommand;
+
+void main() {
+    vBoundsMin = aBoundsMin;
+    vBoundsMax = aBoundsMax;
+    vCommand = aCommand;
+}
+)GLSL";
+
+static const char* cull_geom = 
+R"GLSL(#version 330 core
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+in vec3 vBoundsMin[];
+in vec3 vBoundsMax[];
+flat in uvec4 vCommand[];
+
+uniform vec4 planes[6];
+uniform bool keepCulled;
+
+// DrawElementsIndirectCommand: count, instanceCount, firstIndex, baseVertex, baseInstance
+flat out uvec4 command;
+flat out uint baseInstance;
+
+void main() {
+    bool visible = true;
+    for (int i = 0; i < 6; ++i) {
+        // The box corner furthest along the plane normal
+        vec3 corner = mix(vBoundsMin[0], vBoundsMax[0], greaterThanEqual(planes[i].xyz, vec3(0.0)));
+        if (dot(planes[i].xyz, corner) + planes[i].w < 0.0)
+            visible = false;
+    }
+    if (!visible && !keepCulled)
+        return;
+
+    command = uvec4(vCommand[0].x, visible ? 1u : 0u, vCommand[0].y, vCommand[0].z);
+    baseInstance = vCommand[0].w;
+    EmitVertex();
+    EndPrimitive();
+}
+)GLSL";
+
 static GLuint compileShader(GLenum type, const char* src)
 {
     GLuint sh = glCreateShader(type);
@@ -76,11 +445,22 @@ static GLuint compileShader(GLenum type, const char* src)
     return sh;
 }
 
-static GLuint linkProgram(GLuint v, GLuint f)
+static GLuint linkProgram(GLuint v, GLuint g, GLuint f, const std::vector<std::string>& feedbackVaryings)
 {
     GLuint p = glCreateProgram();
     glAttachShader(p, v);
-    glAttachShader(p, f);
+    if (g) glAttachShader(p, g);
+    if (f) glAttachShader(p, f);
+
+    // Transform feedback outputs have to be named before linking
+    if (!feedbackVaryings.empty())
+    {
+        std::vector<const GLchar*> names;
+        for (const std::string& name : feedbackVaryings)
+            names.push_back(name.c_str());
+        glTransformFeedbackVaryings(p, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+    }
+
     glLinkProgram(p);
     GLint ok = 0; glGetProgramiv(p, GL_LINK_STATUS, &ok);
     if (!ok) {
@@ -110,41 +490,249 @@ Shader::Shader(const std::string& vertexSrc, const std::string& fragmentSrc)
         return;
     }
 
-    m_program = linkProgram(vs, fs);
+    m_program = linkProgram(vs, 0, fs, std::vector<std::string>());
+    if (m_program)
+    {
+        reflectUniforms();
+    }
 
     glDeleteShader(vs);
     glDeleteShader(fs);
 }
 
+Shader::Shader(const std::string& vertexSrc, const std::string& geometrySrc, const std::vector<std::string>& feedbackVaryings)
+{
+    m_program = 0;
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSrc.c_str());
+    if (!vs)
+        return;
+
+    GLuint gs = compileShader(GL_GEOMETRY_SHADER, geometrySrc.c_str());
+    if (!gs)
+    {
+        glDeleteShader(vs);
+        return;
+    }
+
+    m_program = linkProgram(vs, gs, 0, feedbackVaryings);
+    if (m_program)
+    {
+        reflectUniforms();
+    }
+
+    glDeleteShader(vs);
+    glDeleteShader(gs);
+}
+
 void Shader::setCurrent()
 {
     glUseProgram(m_program);
 }
 
-void Shader::setUniformVec3f(const char* name, GLfloat vec[3])
+static bool isFloatType(GLenum type)
 {
-    GLint loc = glGetUniformLocation(m_program, name);
-    if (loc >= 0)
+    return type == GL_FLOAT || type == GL_FLOAT_VEC2 || type == GL_FLOAT_VEC3 || type == GL_FLOAT_VEC4 ||
+           type == GL_FLOAT_MAT2 || type == GL_FLOAT_MAT3 || type == GL_FLOAT_MAT4;
+}
+
+// Words of a uniform value of the given GL type
+static unsigned int valueWords(GLenum type)
+{
+    switch (type)
     {
-        glUniform3f(loc, vec[0], vec[1], vec[2]);
+    case GL_FLOAT_VEC2: return 2;
+    case GL_FLOAT_VEC3: return 3;
+    case GL_FLOAT_VEC4: return 4;
+    case GL_FLOAT_MAT2: return 4;
+    case GL_FLOAT_MAT3: return 9;
+    case GL_FLOAT_MAT4: return 16;
+    case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2: return 2;
+    case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3: return 3;
+    case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: return 4;
+    default: return 1;
     }
-    else
+}
+
+static bool matchesType(GLenum type, UniformType expected)
+{
+    switch (expected)
     {
-        std::cerr << "Warning: uniform '" << name << "' not found in program " << m_program << std::endl;
+    case UNIFORM_INT: return !isFloatType(type) && valueWords(type) == 1;
+    case UNIFORM_FLOAT: return type == GL_FLOAT;
+    case UNIFORM_VEC3: return type == GL_FLOAT_VEC3;
+    case UNIFORM_VEC4: return type == GL_FLOAT_VEC4;
+    case UNIFORM_MAT4: return type == GL_FLOAT_MAT4;
     }
+    return false;
 }
 
-void Shader::setUniformMat4f(const char* name, GLfloat mat[16])
+uint64_t Shader::s_uploads = 0;
+uint64_t Shader::s_skipped = 0;
+
+void Shader::reflectUniforms()
 {
-    GLint loc = glGetUniformLocation(m_program, name);
-    if (loc >= 0)
+    m_uniforms.clear();
+    m_uniformIndex.clear();
+    m_values.clear();
+
+    GLint numUniforms = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &numUniforms);
+
+    for (GLint i = 0; i < numUniforms; ++i)
     {
-        glUniformMatrix4fv(loc, 1, GL_FALSE, mat);
+        GLchar name[256];
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+
+        glGetActiveUniform(m_program, (GLuint)i, sizeof(name) - 1, &length, &size, &type, name);
+        name[length] = '\0';
+
+        // Uniforms of blocks have no location
+        GLint location = glGetUniformLocation(m_program, name);
+        if (location < 0)
+            continue;
+
+        // Arrays are reported as "name[0]"; every element gets its own entry,
+        // the plain name refers to the first one
+        std::string base(name);
+        size_t bracket = base.find('[');
+        if (bracket != std::string::npos)
+        {
+            base.erase(bracket);
+        }
+
+        for (GLint element = 0; element < size; ++element)
+        {
+            UniformInfo info;
+            info.name = size > 1 || bracket != std::string::npos ? base + "[" + std::to_string(element) + "]" : base;
+            info.type = type;
+            info.location = element == 0 ? location : glGetUniformLocation(m_program, info.name.c_str());
+            info.offset = (unsigned int)m_values.size();
+            info.words = valueWords(type);
+            if (info.location < 0)
+                continue;
+
+            m_values.resize(m_values.size() + info.words);
+            m_uniformIndex[info.name] = (int)m_uniforms.size();
+            if (element == 0 && info.name != base)
+            {
+                m_uniformIndex[base] = (int)m_uniforms.size();
+            }
+            m_uniforms.push_back(info);
+        }
     }
-    else
+}
+
+int Shader::findUniform(const char* name, UniformType type) const
+{
+    auto it = m_uniformIndex.find(name);
+    if (it == m_uniformIndex.end() || !matchesType(m_uniforms[it->second].type, type))
+        return -1;
+    return it->second;
+}
+
+int Shader::findNamedUniform(const char* name, UniformType type)
+{
+    int index = findUniform(name, type);
+    if (index < 0 && m_missing.insert(name).second)
     {
         std::cerr << "Warning: uniform '" << name << "' not found in program " << m_program << std::endl;
     }
+    return index;
+}
+
+bool Shader::update(int index, const void* value)
+{
+    UniformInfo& info = m_uniforms[index];
+    uint32_t* cached = &m_values[info.offset];
+    size_t bytes = info.words * sizeof(uint32_t);
+    if (info.hasValue && memcmp(cached, value, bytes) == 0)
+    {
+        ++s_skipped;
+        return false;
+    }
+
+    memcpy(cached, value, bytes);
+    info.hasValue = true;
+    ++s_uploads;
+    return true;
+}
+
+void Shader::set(UniformInt handle, GLint value)
+{
+    if (handle.isValid() && update(handle.index, &value))
+    {
+        glUniform1i(m_uniforms[handle.index].location, value);
+    }
+}
+
+void Shader::set(UniformFloat handle, GLfloat value)
+{
+    if (handle.isValid() && update(handle.index, &value))
+    {
+        glUniform1f(m_uniforms[handle.index].location, value);
+    }
+}
+
+void Shader::set(UniformVec3 handle, const GLfloat vec[3])
+{
+    if (handle.isValid() && update(handle.index, vec))
+    {
+        glUniform3f(m_uniforms[handle.index].location, vec[0], vec[1], vec[2]);
+    }
+}
+
+void Shader::set(UniformVec4 handle, const GLfloat vec[4])
+{
+    if (handle.isValid() && update(handle.index, vec))
+    {
+        glUniform4f(m_uniforms[handle.index].location, vec[0], vec[1], vec[2], vec[3]);
+    }
+}
+
+void Shader::set(UniformMat4 handle, const GLfloat mat[16])
+{
+    if (handle.isValid() && update(handle.index, mat))
+    {
+        glUniformMatrix4fv(m_uniforms[handle.index].location, 1, GL_FALSE, mat);
+    }
+}
+
+void Shader::setUniformVec3f(const char* name, GLfloat vec[3])
+{
+    UniformVec3 handle;
+    handle.index = findNamedUniform(name, UNIFORM_VEC3);
+    set(handle, vec);
+}
+
+void Shader::setUniformVec4f(const char* name, const GLfloat vec[4])
+{
+    UniformVec4 handle;
+    handle.index = findNamedUniform(name, UNIFORM_VEC4);
+    set(handle, vec);
+}
+
+void Shader::setUniform1f(const char* name, GLfloat value)
+{
+    UniformFloat handle;
+    handle.index = findNamedUniform(name, UNIFORM_FLOAT);
+    set(handle, value);
+}
+
+void Shader::setUniform1i(const char* name, GLint value)
+{
+    UniformInt handle;
+    handle.index = findNamedUniform(name, UNIFORM_INT);
+    set(handle, value);
+}
+
+void Shader::setUniformMat4f(const char* name, GLfloat mat[16])
+{
+    UniformMat4 handle;
+    handle.index = findNamedUniform(name, UNIFORM_MAT4);
+    set(handle, mat);
 }
 
 void Shader::DebugPrintUniforms()
@@ -154,24 +742,78 @@ void Shader::DebugPrintUniforms()
         return;
     }
 
-    GLint numUniforms = 0;
-    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &numUniforms);
     std::cerr << "\n=== Shader Program " << m_program << " ===" << std::endl;
-    std::cerr << "Active Uniforms: " << numUniforms << std::endl;
+    std::cerr << "Active Uniforms: " << m_uniforms.size() << std::endl;
 
-    for (GLint i = 0; i < numUniforms; ++i) {
-        GLchar name[256];
-        GLsizei length = 0;
-        GLint size = 0;
-        GLenum type = 0;
+    for (size_t i = 0; i < m_uniforms.size(); ++i) {
+        const UniformInfo& info = m_uniforms[i];
+        std::cerr << "  [" << i << "] " << info.name << " (type=" << info.type << ", words=" << info.words << ", location=" << info.location << ")" << std::endl;
+    }
+    std::cerr << "=======================\n" << std::endl;
+}
 
-        glGetActiveUniform(m_program, (GLuint)i, sizeof(name) - 1, &length, &size, &type, name);
-        name[length] = '\0';
+void Shader::benchmarkUniforms(unsigned int iterations)
+{
+    Shader* shader = GetDefaultShader();
+    if (shader->getProgram() == 0)
+        return;
+    shader->setCurrent();
 
-        GLint location = glGetUniformLocation(m_program, name);
-        std::cerr << "  [" << i << "] " << name << " (type=" << type << ", size=" << size << ", location=" << location << ")" << std::endl;
+    // Two alternating matrices, so every call of the first runs is a real change
+    GLfloat mats[2][16];
+    for (int m = 0; m < 2; ++m)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            mats[m][i] = (i % 5 == 0 ? 1.0f : 0.0f) + 0.001f * (float)m;
+        }
     }
-    std::cerr << "=======================\n" << std::endl;
+    const char* names[2] = { "mvp", "model" };
+
+    auto run = [&](const char* label, bool changing, int mode)
+    {
+        UniformMat4 handles[2] = { shader->getUniform<UNIFORM_MAT4>(names[0]), shader->getUniform<UNIFORM_MAT4>(names[1]) };
+
+        // The uncached run changes the program behind the table's back
+        for (UniformInfo& info : shader->m_uniforms)
+        {
+            info.hasValue = false;
+        }
+        resetCounters();
+        glFinish();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (unsigned int i = 0; i < iterations; ++i)
+        {
+            const GLfloat* mat = mats[changing ? (i & 1) : 0];
+            for (int u = 0; u < 2; ++u)
+            {
+                if (mode == 0)
+                {
+                    // What every setter did before the table
+                    glUniformMatrix4fv(glGetUniformLocation(shader->m_program, names[u]), 1, GL_FALSE, mat);
+                }
+                else if (mode == 1)
+                {
+                    shader->setUniformMat4f(names[u], const_cast<GLfloat*>(mat));
+                }
+                else
+                {
+                    shader->set(handles[u], mat);
+                }
+            }
+        }
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        printf("  %-34s %8.2f ms  %6.1f ns/call  uploads %u  skipped %u\n",
+            label, ms, ms * 1e6 / (iterations * 2.0), (unsigned)s_uploads, (unsigned)s_skipped);
+    };
+
+    printf("Uniform benchmark: %u iterations x 2 mat4 uniforms\n", iterations);
+    run("glGetUniformLocation per call", true, 0);
+    run("table lookup by name", true, 1);
+    run("typed handle", true, 2);
+    run("typed handle, unchanged value", false, 2);
+    resetCounters();
 }
 
 Shader* Shader::GetDefaultShader()
@@ -181,3 +823,43 @@ Shader* Shader::GetDefaultShader()
         s_shader = new Shader(simple_vert, simple_frag);
     return s_shader;
 }
+
+Shader* Shader::GetInstancedShader()
+{
+    static Shader* s_shader = nullptr;
+    if (s_shader == nullptr)
+        s_shader = new Shader(instanced_vert, instanced_frag);
+    return s_shader;
+}
+
+Shader* Shader::GetImpostorShader()
+{
+    static Shader* s_shader = nullptr;
+    if (s_shader == nullptr)
+        s_shader = new Shader(impostor_vert, impostor_frag);
+    return s_shader;
+}
+
+Shader* Shader::GetObjectDataShader()
+{
+    static Shader* s_shader = nullptr;
+    if (s_shader == nullptr)
+        s_shader = new Shader(object_data_vert, instanced_frag);
+    return s_shader;
+}
+
+Shader* Shader::GetCullShader()
+{
+    static Shader* s_shader = nullptr;
+    if (s_shader == nullptr)
+        s_shader = new Shader(cull_vert, cull_geom, std::vector<std::string>{ "command", "baseInstance" });
+    return s_shader;
+}
+
+Shader* Shader::GetProceduralSphereShader()
+{
+    static Shader* s_shader = nullptr;
+    if (s_shader == nullptr)
+        s_shader = new Shader(procedural_sphere_vert, simple_frag);
+    return s_shader;
+}
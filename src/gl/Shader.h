@@ -2,24 +2,137 @@
 
 #include <GL/glew.h>
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+enum UniformType
+{
+    UNIFORM_INT,    // int, bool and samplers
+    UNIFORM_FLOAT,
+    UNIFORM_VEC3,
+    UNIFORM_VEC4,
+    UNIFORM_MAT4
+};
+
+// Index into the uniform table of one Shader; the type parameter makes a
+// handle usable only with the matching Shader::set() overload
+template <UniformType T>
+struct UniformHandle
+{
+    int index = -1;
+    bool isValid() const { return index >= 0; }
+};
+
+typedef UniformHandle<UNIFORM_INT> UniformInt;
+typedef UniformHandle<UNIFORM_FLOAT> UniformFloat;
+typedef UniformHandle<UNIFORM_VEC3> UniformVec3;
+typedef UniformHandle<UNIFORM_VEC4> UniformVec4;
+typedef UniformHandle<UNIFORM_MAT4> UniformMat4;
 
 class Shader
 {
 public:
     static Shader* GetDefaultShader();
 
+    // Shader for InstancedRenderObject (per-instance attributes 3..5)
+    static Shader* GetInstancedShader();
+
+    // Shader for SphereImpostors (ray-cast spheres on camera facing quads)
+    static Shader* GetImpostorShader();
+
+    // Default shading with per-object data from an ObjectDataBuffer, used
+    // by RenderQueue and the multi-draw indirect path of GpuDrivenRenderer
+    static Shader* GetObjectDataShader();
+
+    // Transform feedback program writing the visible indirect draw commands
+    static Shader* GetCullShader();
+
+    // Shader for procedural Spheres (vertices rebuilt from gl_VertexID and shapeParams)
+    static Shader* GetProceduralSphereShader();
+
     Shader(const std::string& vertexSrc, const std::string& fragmentSrc);
+
+    // Rasterizer-less program whose geometry shader outputs are captured
+    // with transform feedback, interleaved in the order given
+    Shader(const std::string& vertexSrc, const std::string& geometrySrc, const std::vector<std::string>& feedbackVaryings);
     ~Shader();
 
     void setCurrent();
 
+    GLuint getProgram() const { return m_program; }
+
+    // Handle of an active uniform, invalid when the program has none of
+    // that name and type. Array elements are looked up as "name[i]".
+    template <UniformType T>
+    UniformHandle<T> getUniform(const char* name) const
+    {
+        UniformHandle<T> handle;
+        handle.index = findUniform(name, T);
+        return handle;
+    }
+
+    // Upload to the current program unless the uniform already holds the
+    // value; invalid handles are ignored
+    void set(UniformInt handle, GLint value);
+    void set(UniformFloat handle, GLfloat value);
+    void set(UniformVec3 handle, const GLfloat vec[3]);
+    void set(UniformVec4 handle, const GLfloat vec[4]);
+    void set(UniformMat4 handle, const GLfloat mat[16]);
+
+    // By name, through the same table; a missing uniform is reported once
     void setUniformVec3f(const char* name, GLfloat vec[3]);
 
+    void setUniformVec4f(const char* name, const GLfloat vec[4]);
+
+    void setUniform1f(const char* name, GLfloat value);
+
+    void setUniform1i(const char* name, GLint value);
+
     void setUniformMat4f(const char* name, GLfloat mat[16]);
 
     void DebugPrintUniforms();
 
+    // Uniform uploads issued and skipped as redundant, over all shaders
+    static uint64_t getUploadCount() { return s_uploads; }
+    static uint64_t getSkippedCount() { return s_skipped; }
+    static void resetCounters() { s_uploads = 0; s_skipped = 0; }
+
+    // Time glGetUniformLocation per call against table lookups by name and
+    // typed handles, with changing and unchanged values, and print the results
+    static void benchmarkUniforms(unsigned int iterations);
+
 private:
+    struct UniformInfo
+    {
+        std::string name;
+        GLenum type = 0;     // as reported by glGetActiveUniform
+        GLint location = -1;
+        unsigned int offset = 0; // first word of the value in m_values
+        unsigned int words = 0;
+        bool hasValue = false;   // m_values holds what the program holds
+    };
+
+    // Read the active uniforms of the linked program into the table
+    void reflectUniforms();
+
+    int findUniform(const char* name, UniformType type) const;
+
+    // findUniform for the by-name setters, warns once per missing name
+    int findNamedUniform(const char* name, UniformType type);
+
+    // Compare with and store the cached value; false when it is unchanged
+    bool update(int index, const void* value);
+
     GLuint m_program;
+
+    std::vector<UniformInfo> m_uniforms;
+    std::unordered_map<std::string, int> m_uniformIndex;
+    std::vector<uint32_t> m_values;
+    std::unordered_set<std::string> m_missing; // names already reported
+
+    static uint64_t s_uploads;
+    static uint64_t s_skipped;
 };
 
@@ -9,15 +9,30 @@
     #include <fcntl.h>
 #endif
 
+#ifdef __WXGTK__
+    #include <X11/Xlib.h>
+#endif
+
 class MyApp : public wxApp
 {
 public:
+    MyApp();
     virtual bool OnInit() override;
 };
 
 // Implement the application class
 wxIMPLEMENT_APP(MyApp);
 
+MyApp::MyApp()
+{
+#ifdef __WXGTK__
+    // The render thread makes the GL context current and swaps buffers
+    // while GTK uses the same display, so Xlib has to be thread safe.
+    // The app object is created before wxWidgets opens the display.
+    XInitThreads();
+#endif
+}
+
 bool MyApp::OnInit()
 {
 #ifdef _WIN32
@@ -34,6 +49,25 @@ bool MyApp::OnInit()
         // Create the main application window
         printf("Creating main frame...\n");
         MainFrame* frame = new MainFrame();
+
+        // --render=immediate|client|vbo|vao|auto; auto (the default) times
+        // every backend once the GL context exists
+        for (int i = 1; i < argc; ++i)
+        {
+            wxString value;
+            if (!wxString(argv[i]).StartsWith("--render=", &value) || value == "auto")
+                continue;
+
+            RenderMethod method;
+            if (parseRenderMethod(value.mb_str(), method))
+            {
+                frame->SetRenderMethod(method);
+            }
+            else
+            {
+                printf("Unknown render method '%s', expected immediate, client, vbo, vao or auto\n", (const char*)value.mb_str());
+            }
+        }
         
         // Show the frame
         printf("Showing frame...\n");
@@ -49,4 +83,4 @@ bool MyApp::OnInit()
         printf("Unknown exception occurred!\n");
         return false;
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
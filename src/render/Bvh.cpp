@@ -0,0 +1,327 @@
+#include "Bvh.h"
+#include <algorithm>
+#include <cfloat>
+
+
+static const unsigned int BIN_COUNT = 12;
+static const unsigned int MAX_LEAF_SIZE = 4;
+static const float TRAVERSAL_COST = 1.0f;
+static const float REBUILD_RATIO = 1.5f;
+
+struct Box
+{
+    float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    void grow(const float bmin[3], const float bmax[3])
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            if (bmin[k] < min[k]) min[k] = bmin[k];
+            if (bmax[k] > max[k]) max[k] = bmax[k];
+        }
+    }
+
+    void grow(const Box& other) { grow(other.min, other.max); }
+
+    float area() const
+    {
+        float dx = max[0] - min[0];
+        float dy = max[1] - min[1];
+        float dz = max[2] - min[2];
+        if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+            return 0.0f;
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+};
+
+static float boxArea(const float min[3], const float max[3])
+{
+    Box box;
+    box.grow(min, max);
+    return box.area();
+}
+
+static float centroid(const DrawItem& item, int axis)
+{
+    return 0.5f * (item.boundsMin[axis] + item.boundsMax[axis]);
+}
+
+void Bvh::build(const std::vector<DrawItem>& items)
+{
+    m_nodes.clear();
+    m_refs.resize(items.size());
+    for (size_t i = 0; i < m_refs.size(); ++i)
+    {
+        m_refs[i] = (unsigned int)i;
+    }
+
+    if (items.empty())
+    {
+        m_buildCost = m_cost = 0.0f;
+        return;
+    }
+
+    m_nodes.reserve(2 * items.size());
+    Node root;
+    root.first = 0;
+    root.count = (unsigned int)items.size();
+    m_nodes.push_back(root);
+    updateBounds(m_nodes[0], items);
+    subdivide(0, items);
+
+    m_buildCost = m_cost = computeCost();
+}
+
+void Bvh::updateBounds(Node& node, const std::vector<DrawItem>& items) const
+{
+    Box box;
+    for (unsigned int i = 0; i < node.count; ++i)
+    {
+        const DrawItem& item = items[m_refs[node.first + i]];
+        box.grow(&item.boundsMin[0], &item.boundsMax[0]);
+    }
+    for (int k = 0; k < 3; ++k)
+    {
+        node.min[k] = box.min[k];
+        node.max[k] = box.max[k];
+    }
+}
+
+void Bvh::subdivide(unsigned int nodeIndex, const std::vector<DrawItem>& items)
+{
+    Node node = m_nodes[nodeIndex];
+    if (node.count <= 1)
+        return;
+
+    // Bin the centroids along every axis and keep the cheapest split plane
+    Box centroidBox;
+    for (unsigned int i = 0; i < node.count; ++i)
+    {
+        const DrawItem& item = items[m_refs[node.first + i]];
+        float c[3] = { centroid(item, 0), centroid(item, 1), centroid(item, 2) };
+        centroidBox.grow(c, c);
+    }
+
+    int bestAxis = -1;
+    unsigned int bestSplit = 0;
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float lo = centroidBox.min[axis];
+        float hi = centroidBox.max[axis];
+        if (hi <= lo)
+            continue;
+
+        Box bins[BIN_COUNT];
+        unsigned int counts[BIN_COUNT] = {};
+        float scale = BIN_COUNT / (hi - lo);
+        for (unsigned int i = 0; i < node.count; ++i)
+        {
+            const DrawItem& item = items[m_refs[node.first + i]];
+            unsigned int bin = std::min(BIN_COUNT - 1, (unsigned int)((centroid(item, axis) - lo) * scale));
+            bins[bin].grow(&item.boundsMin[0], &item.boundsMax[0]);
+            counts[bin]++;
+        }
+
+        // Sweep from the right to get the area and count of every right side
+        float rightArea[BIN_COUNT];
+        unsigned int rightCount[BIN_COUNT];
+        Box right;
+        unsigned int count = 0;
+        for (unsigned int b = BIN_COUNT - 1; b > 0; --b)
+        {
+            right.grow(bins[b]);
+            count += counts[b];
+            rightArea[b] = right.area();
+            rightCount[b] = count;
+        }
+
+        Box left;
+        count = 0;
+        for (unsigned int b = 1; b < BIN_COUNT; ++b)
+        {
+            left.grow(bins[b - 1]);
+            count += counts[b - 1];
+            if (count == 0 || rightCount[b] == 0)
+                continue;
+
+            float cost = left.area() * count + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    float parentArea = boxArea(node.min, node.max);
+    float leafCost = (float)node.count;
+    float splitCost = parentArea > 0.0f ? TRAVERSAL_COST + bestCost / parentArea : FLT_MAX;
+
+    unsigned int* begin = m_refs.data() + node.first;
+    unsigned int* end = begin + node.count;
+    unsigned int* middle = nullptr;
+    if (bestAxis >= 0 && (splitCost < leafCost || node.count > MAX_LEAF_SIZE))
+    {
+        float lo = centroidBox.min[bestAxis];
+        float scale = BIN_COUNT / (centroidBox.max[bestAxis] - lo);
+        middle = std::partition(begin, end, [&](unsigned int ref)
+        {
+            unsigned int bin = std::min(BIN_COUNT - 1, (unsigned int)((centroid(items[ref], bestAxis) - lo) * scale));
+            return bin < bestSplit;
+        });
+    }
+    else if (node.count > MAX_LEAF_SIZE)
+    {
+        // All centroids coincide; split the list in half to bound the leaf size
+        middle = begin + node.count / 2;
+    }
+    else
+    {
+        return;
+    }
+
+    unsigned int leftCount = (unsigned int)(middle - begin);
+    unsigned int childIndex = (unsigned int)m_nodes.size();
+
+    Node left;
+    left.first = node.first;
+    left.count = leftCount;
+    Node right;
+    right.first = node.first + leftCount;
+    right.count = node.count - leftCount;
+    m_nodes.push_back(left);
+    m_nodes.push_back(right);
+    updateBounds(m_nodes[childIndex], items);
+    updateBounds(m_nodes[childIndex + 1], items);
+
+    m_nodes[nodeIndex].first = childIndex;
+    m_nodes[nodeIndex].count = 0;
+
+    subdivide(childIndex, items);
+    subdivide(childIndex + 1, items);
+}
+
+void Bvh::refit(const std::vector<DrawItem>& items)
+{
+    if (m_refs.size() != items.size())
+    {
+        build(items);
+        return;
+    }
+
+    // Children are always stored after their parent
+    for (size_t i = m_nodes.size(); i-- > 0;)
+    {
+        Node& node = m_nodes[i];
+        if (node.count > 0)
+        {
+            updateBounds(node, items);
+            continue;
+        }
+
+        const Node& left = m_nodes[node.first];
+        const Node& right = m_nodes[node.first + 1];
+        for (int k = 0; k < 3; ++k)
+        {
+            node.min[k] = std::min(left.min[k], right.min[k]);
+            node.max[k] = std::max(left.max[k], right.max[k]);
+        }
+    }
+
+    m_cost = computeCost();
+}
+
+bool Bvh::needsRebuild() const
+{
+    return m_cost > REBUILD_RATIO * m_buildCost;
+}
+
+float Bvh::computeCost() const
+{
+    if (m_nodes.empty())
+        return 0.0f;
+
+    float rootArea = boxArea(m_nodes[0].min, m_nodes[0].max);
+    if (rootArea <= 0.0f)
+        return 0.0f;
+
+    float cost = 0.0f;
+    for (const Node& node : m_nodes)
+    {
+        float area = boxArea(node.min, node.max);
+        cost += area * (node.count > 0 ? (float)node.count : TRAVERSAL_COST);
+    }
+    return cost / rootArea;
+}
+
+void Bvh::markSubtree(const Node& node, std::vector<DrawItem>& items, bool visible, CullStats& stats) const
+{
+    if (node.count > 0)
+    {
+        for (unsigned int i = 0; i < node.count; ++i)
+        {
+            items[m_refs[node.first + i]].visible = visible;
+        }
+        if (visible)
+            stats.visible += node.count;
+        else
+            stats.culled += node.count;
+        return;
+    }
+
+    markSubtree(m_nodes[node.first], items, visible, stats);
+    markSubtree(m_nodes[node.first + 1], items, visible, stats);
+}
+
+Bvh::CullStats Bvh::cull(const Frustum& frustum, std::vector<DrawItem>& items) const
+{
+    CullStats stats;
+    if (m_nodes.empty() || m_refs.size() != items.size())
+    {
+        for (DrawItem& item : items)
+        {
+            item.visible = true;
+        }
+        stats.visible = (unsigned int)items.size();
+        return stats;
+    }
+
+    unsigned int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node& node = m_nodes[stack[--top]];
+        Frustum::Result result = frustum.testBox(node.min, node.max);
+
+        if (result != Frustum::FRUSTUM_INTERSECT || top + 2 > 64)
+        {
+            // Whole subtree in or out
+            markSubtree(node, items, result != Frustum::FRUSTUM_OUTSIDE, stats);
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            // Leaf straddling a plane: test its items one by one
+            for (unsigned int i = 0; i < node.count; ++i)
+            {
+                DrawItem& item = items[m_refs[node.first + i]];
+                item.visible = frustum.testBox(&item.boundsMin[0], &item.boundsMax[0]) != Frustum::FRUSTUM_OUTSIDE;
+                if (item.visible)
+                    stats.visible++;
+                else
+                    stats.culled++;
+            }
+            continue;
+        }
+
+        stack[top++] = node.first + 1;
+        stack[top++] = node.first;
+    }
+
+    return stats;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "RenderQueue.h"
+#include "Frustum.h"
+
+/**
+ * Bounding volume hierarchy over the draw items of a RenderQueue.
+ *
+ * Built top-down with a binned surface area heuristic. When objects only
+ * move, refit() updates the boxes bottom-up in linear time and keeps the
+ * topology; once the refitted tree has become noticeably worse than a
+ * fresh build, needsRebuild() says so.
+ */
+class Bvh
+{
+public:
+    struct CullStats
+    {
+        unsigned int visible = 0;
+        unsigned int culled = 0;
+    };
+
+    void build(const std::vector<DrawItem>& items);
+
+    // Update all boxes from the items' current bounds; the items must be
+    // the same (and in the same order) as for the last build()
+    void refit(const std::vector<DrawItem>& items);
+
+    // True when the SAH cost grew past REBUILD_RATIO times the build cost
+    bool needsRebuild() const;
+
+    // Set DrawItem::visible of every item against the frustum
+    CullStats cull(const Frustum& frustum, std::vector<DrawItem>& items) const;
+
+    bool empty() const { return m_nodes.empty(); }
+    size_t nodeCount() const { return m_nodes.size(); }
+
+private:
+    struct Node
+    {
+        float min[3];
+        float max[3];
+        unsigned int first; // leaf: first reference, inner: left child (right is first + 1)
+        unsigned int count; // number of references, 0 for inner nodes
+    };
+
+    void subdivide(unsigned int nodeIndex, const std::vector<DrawItem>& items);
+    void updateBounds(Node& node, const std::vector<DrawItem>& items) const;
+    void markSubtree(const Node& node, std::vector<DrawItem>& items, bool visible, CullStats& stats) const;
+    float computeCost() const;
+
+    std::vector<Node> m_nodes;
+    std::vector<unsigned int> m_refs;   // item indices, grouped by leaf
+    float m_buildCost = 0.0f;
+    float m_cost = 0.0f;
+};
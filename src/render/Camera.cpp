@@ -0,0 +1,49 @@
+#include "Camera.h"
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+
+Camera::Camera()
+{
+    update();
+}
+
+void Camera::setViewport(int width, int height)
+{
+    if (width == m_width && height == m_height)
+        return;
+
+    m_width = width;
+    m_height = height;
+    update();
+}
+
+void Camera::setDepth(float halfDepth)
+{
+    if (halfDepth == m_halfDepth)
+        return;
+
+    m_halfDepth = halfDepth;
+    update();
+}
+
+void Camera::update()
+{
+    // Y-axis inverted for screen coordinates
+    m_projection = glm::ortho(0.0f, (float)m_width, (float)m_height, 0.0f, -m_halfDepth, m_halfDepth);
+
+    // The panel is drawn in world coordinates, the view is the identity
+    m_view = glm::mat4(1.0f);
+    m_viewProjection = m_projection * m_view;
+
+    m_eye = glm::vec3((float)m_width / 2.0f, (float)m_height / 2.0f, 500.0f);
+}
+
+void Camera::loadFixedFunction() const
+{
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(&m_projection[0][0]);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(&m_view[0][0]);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * Camera of the drawing panel, owned by SceneGraph.
+ *
+ * An orthographic projection in panel coordinates (x right, y down, one
+ * unit per pixel) with a depth range symmetric around z = 0, and the view
+ * matrix and eye position used for lighting. All matrices are computed
+ * with glm and passed down explicitly; only the fixed-function backends
+ * copy them into GL with loadFixedFunction().
+ */
+class Camera
+{
+public:
+    Camera();
+
+    void setViewport(int width, int height);
+
+    // Visible depth from -halfDepth to +halfDepth
+    void setDepth(float halfDepth);
+
+    const glm::mat4& getProjection() const { return m_projection; }
+    const glm::mat4& getView() const { return m_view; }
+    const glm::mat4& getViewProjection() const { return m_viewProjection; }
+
+    // Above the panel center, for specular lighting
+    const glm::vec3& getEyePosition() const { return m_eye; }
+
+    // Load GL_PROJECTION and GL_MODELVIEW (legacy backends only)
+    void loadFixedFunction() const;
+
+private:
+    void update();
+
+    int m_width = 0;
+    int m_height = 0;
+    float m_halfDepth = 1.0f;
+
+    glm::vec3 m_eye = glm::vec3(0.0f, 0.0f, 500.0f);
+    glm::mat4 m_projection = glm::mat4(1.0f);
+    glm::mat4 m_view = glm::mat4(1.0f);
+    glm::mat4 m_viewProjection = glm::mat4(1.0f);
+};
@@ -0,0 +1,108 @@
+#include "Frustum.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE2 1
+#include <emmintrin.h>
+#else
+#define FRUSTUM_SSE2 0
+#endif
+
+
+Frustum::Frustum()
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        m_a[i] = 0.0f;
+        m_b[i] = 0.0f;
+        m_c[i] = 0.0f;
+        m_d[i] = 1.0f;
+    }
+}
+
+void Frustum::extract(const glm::mat4& m)
+{
+    // Rows of the column-major matrix
+    float row[4][4];
+    for (int r = 0; r < 4; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            row[r][c] = m[c][r];
+        }
+    }
+
+    // left, right, bottom, top, near, far: row3 +/- row0, row1, row2
+    for (int i = 0; i < 6; ++i)
+    {
+        int axis = i / 2;
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        m_a[i] = row[3][0] + sign * row[axis][0];
+        m_b[i] = row[3][1] + sign * row[axis][1];
+        m_c[i] = row[3][2] + sign * row[axis][2];
+        m_d[i] = row[3][3] + sign * row[axis][3];
+    }
+
+    // padding planes that every box is fully inside of
+    for (int i = 6; i < 8; ++i)
+    {
+        m_a[i] = 0.0f;
+        m_b[i] = 0.0f;
+        m_c[i] = 0.0f;
+        m_d[i] = 1.0f;
+    }
+}
+
+Frustum::Result Frustum::testBox(const float min[3], const float max[3]) const
+{
+    float center[3] = { 0.5f * (min[0] + max[0]), 0.5f * (min[1] + max[1]), 0.5f * (min[2] + max[2]) };
+    float extent[3] = { 0.5f * (max[0] - min[0]), 0.5f * (max[1] - min[1]), 0.5f * (max[2] - min[2]) };
+
+    // For every plane: signed distance of the center and the projected radius
+    // of the box onto the plane normal (both scaled by the normal length)
+#if FRUSTUM_SSE2
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 cx = _mm_set1_ps(center[0]);
+    __m128 cy = _mm_set1_ps(center[1]);
+    __m128 cz = _mm_set1_ps(center[2]);
+    __m128 ex = _mm_set1_ps(extent[0]);
+    __m128 ey = _mm_set1_ps(extent[1]);
+    __m128 ez = _mm_set1_ps(extent[2]);
+
+    int outside = 0;
+    int inside = 0xFF;
+    for (int i = 0; i < 8; i += 4)
+    {
+        __m128 a = _mm_load_ps(m_a + i);
+        __m128 b = _mm_load_ps(m_b + i);
+        __m128 c = _mm_load_ps(m_c + i);
+        __m128 d = _mm_load_ps(m_d + i);
+
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_add_ps(_mm_mul_ps(c, cz), d));
+        __m128 radius = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_andnot_ps(signMask, a), ex),
+            _mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+            _mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+
+        __m128 zero = _mm_setzero_ps();
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), zero)) << i;
+        inside &= ~(_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), zero)) << i);
+    }
+
+    if (outside)
+        return FRUSTUM_OUTSIDE;
+    return inside == 0xFF ? FRUSTUM_INSIDE : FRUSTUM_INTERSECT;
+#else
+    Result result = FRUSTUM_INSIDE;
+    for (int i = 0; i < 6; ++i)
+    {
+        float dist = m_a[i] * center[0] + m_b[i] * center[1] + m_c[i] * center[2] + m_d[i];
+        float radius = std::fabs(m_a[i]) * extent[0] + std::fabs(m_b[i]) * extent[1] + std::fabs(m_c[i]) * extent[2];
+        if (dist + radius < 0.0f)
+            return FRUSTUM_OUTSIDE;
+        if (dist - radius < 0.0f)
+            result = FRUSTUM_INTERSECT;
+    }
+    return result;
+#endif
+}
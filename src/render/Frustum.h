@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * View frustum as six planes, tested against axis aligned boxes.
+ *
+ * The planes are extracted from a combined projection * view matrix
+ * (Gribb/Hartmann) and stored as structure of arrays, padded to eight, so
+ * one box is classified against four planes per SSE instruction.
+ */
+class Frustum
+{
+public:
+    enum Result
+    {
+        FRUSTUM_OUTSIDE,
+        FRUSTUM_INTERSECT,
+        FRUSTUM_INSIDE
+    };
+
+    Frustum();
+
+    // Planes of the clip volume of viewProjection, in the space its input is in
+    void extract(const glm::mat4& viewProjection);
+
+    Result testBox(const float min[3], const float max[3]) const;
+
+    // Plane i (0..5) as a, b, c, d
+    void getPlane(int i, float plane[4]) const { plane[0] = m_a[i]; plane[1] = m_b[i]; plane[2] = m_c[i]; plane[3] = m_d[i]; }
+
+private:
+    // a * x + b * y + c * z + d >= 0 inside; planes 6 and 7 always pass
+    alignas(16) float m_a[8];
+    alignas(16) float m_b[8];
+    alignas(16) float m_c[8];
+    alignas(16) float m_d[8];
+};
@@ -0,0 +1,120 @@
+#include "GeometryCache.h"
+#include "MeshBuffer.h"
+#include "VertexArena.h"
+#include <cstdio>
+#include <cstring>
+
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+GLint GeometryBuffers::baseVertex() const
+{
+    return arena ? arena->getRange(allocation).baseVertex : 0;
+}
+
+size_t GeometryBuffers::indexOffset() const
+{
+    return arena ? arena->getRange(allocation).indexOffset : 0;
+}
+
+GeometryCache& GeometryCache::global()
+{
+    static GeometryCache s_cache;
+    return s_cache;
+}
+
+std::shared_ptr<const GeometryBuffers> GeometryCache::find(uint64_t key)
+{
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        std::shared_ptr<const GeometryBuffers> buffers = it->second.lock();
+        if (buffers)
+        {
+            ++m_hits;
+            return buffers;
+        }
+    }
+
+    ++m_misses;
+    return nullptr;
+}
+
+std::shared_ptr<const GeometryBuffers> GeometryCache::insert(uint64_t key, const GeometryBuffers& buffers)
+{
+    std::shared_ptr<const GeometryBuffers> handle(new GeometryBuffers(buffers), [this, key](GeometryBuffers* released)
+    {
+        release(key, released);
+    });
+
+    m_entries[key] = handle;
+    m_residentBytes += buffers.bytes;
+    return handle;
+}
+
+void GeometryCache::release(uint64_t key, GeometryBuffers* buffers)
+{
+    if (buffers->arena) { buffers->arena->free(buffers->allocation); }
+    if (buffers->vbo) { glDeleteBuffers(1, &buffers->vbo); }
+    if (buffers->ibo) { glDeleteBuffers(1, &buffers->ibo); }
+    m_residentBytes -= buffers->bytes;
+
+    // The entry may already point at newer buffers uploaded under the same key
+    auto it = m_entries.find(key);
+    if (it != m_entries.end() && it->second.expired())
+    {
+        m_entries.erase(it);
+    }
+
+    delete buffers;
+}
+
+uint64_t GeometryCache::hashMesh(const MeshBuffer& mesh)
+{
+    uint64_t hash = FNV_OFFSET;
+    size_t sizes[5] = { mesh.vertexCount(), mesh.hasNormals(), mesh.hasTexCoords(), mesh.hasColors(), mesh.indices().size() };
+    hash = hashBytes(hash, sizes, sizeof(sizes));
+
+    size_t vertexCount = mesh.vertexCount();
+    hash = hashBytes(hash, mesh.positions(), vertexCount * 3 * sizeof(float));
+    if (mesh.hasNormals())
+        hash = hashBytes(hash, mesh.normals(), vertexCount * 3 * sizeof(float));
+    if (mesh.hasTexCoords())
+        hash = hashBytes(hash, mesh.texCoords(), vertexCount * 2 * sizeof(float));
+    if (mesh.hasColors())
+        hash = hashBytes(hash, mesh.colors(), vertexCount * 3 * sizeof(float));
+    hash = hashBytes(hash, mesh.indices().data(), mesh.indices().size() * sizeof(unsigned int));
+    return hash;
+}
+
+uint64_t GeometryCache::hashValues(const char* generator, const double* values, size_t count)
+{
+    uint64_t hash = hashBytes(FNV_OFFSET, generator, strlen(generator));
+    return hashBytes(hash, values, count * sizeof(double));
+}
+
+uint64_t GeometryCache::combine(uint64_t key, uint64_t value)
+{
+    return hashBytes(key, &value, sizeof(value));
+}
+
+void GeometryCache::printStats() const
+{
+    printf("GeometryCache: %u meshes resident, %u bytes, %u hits, %u misses\n",
+        (unsigned)m_entries.size(),
+        (unsigned)m_residentBytes,
+        (unsigned)m_hits,
+        (unsigned)m_misses);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include "VertexFormat.h"
+
+class MeshBuffer;
+class VertexArena;
+
+/**
+ * GPU buffers of one uploaded mesh, shared by every object drawing the
+ * same geometry. The mesh either lives in a range of a VertexArena, drawn
+ * through the arena's VAO, or in buffers of its own; in that case every
+ * object owns its VAO (instanced objects add their attributes to it).
+ */
+struct GeometryBuffers
+{
+    GLuint vbo = 0;                    // own buffers, 0 for arena ranges
+    GLuint ibo = 0;                    // 0 for non-indexed meshes
+    VertexArena* arena = nullptr;
+    unsigned int allocation = 0;       // arena handle
+    VertexLayout layout;
+    GLenum indexType = 0;              // 0 for non-indexed meshes
+    GLsizei drawCount = 0;             // vertices or indices
+    size_t vertexCount = 0;
+    size_t bytes = 0;                  // vertex + index data size
+
+    // Draw offsets; arena ranges may move when the arena is compacted
+    GLint baseVertex() const;
+    size_t indexOffset() const;
+};
+
+/**
+ * Process-wide cache of uploaded meshes keyed by a 64-bit hash, either of
+ * the generator parameters (see RenderObject::getGeometryKey) or of the
+ * mesh content. Handles are reference counted: the buffers are deleted
+ * when the last object releases them, so the GL context must be current
+ * whenever a handle may be dropped.
+ */
+class GeometryCache
+{
+public:
+    static GeometryCache& global();
+
+    // Shared buffers for key, or nullptr on a miss
+    std::shared_ptr<const GeometryBuffers> find(uint64_t key);
+
+    // Take ownership of freshly uploaded buffers
+    std::shared_ptr<const GeometryBuffers> insert(uint64_t key, const GeometryBuffers& buffers);
+
+    // FNV-1a over every attribute array and the indices
+    static uint64_t hashMesh(const MeshBuffer& mesh);
+    // FNV-1a over a generator name and its parameters
+    static uint64_t hashValues(const char* generator, const double* values, size_t count);
+    static uint64_t combine(uint64_t key, uint64_t value);
+
+    size_t getHits() const { return m_hits; }
+    size_t getMisses() const { return m_misses; }
+    size_t getEntryCount() const { return m_entries.size(); }
+    size_t getResidentBytes() const { return m_residentBytes; }
+    void resetCounters() { m_hits = 0; m_misses = 0; }
+
+    void printStats() const;
+
+private:
+    void release(uint64_t key, GeometryBuffers* buffers);
+
+    std::unordered_map<uint64_t, std::weak_ptr<const GeometryBuffers>> m_entries;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+    size_t m_residentBytes = 0;
+};
@@ -0,0 +1,315 @@
+#include "GpuDrivenRenderer.h"
+#include "RenderObject.h"
+#include "VertexArena.h"
+#include "Frustum.h"
+#include "../gl/Shader.h"
+#include <algorithm>
+#include <cstdio>
+
+
+static const size_t COMMAND_SIZE = 5 * sizeof(GLuint); // DrawElementsIndirectCommand
+
+GpuDrivenRenderer::~GpuDrivenRenderer()
+{
+    release();
+}
+
+bool GpuDrivenRenderer::isSupported()
+{
+    bool multiDraw = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+    return multiDraw && GLEW_VERSION_3_2;
+}
+
+void GpuDrivenRenderer::release()
+{
+    for (Group& group : m_groups)
+    {
+        if (group.vao) { glDeleteVertexArrays(1, &group.vao); }
+        if (group.query) { glDeleteQueries(1, &group.query); }
+    }
+    m_groups.clear();
+    m_items.clear();
+
+    if (m_cullVao) { glDeleteVertexArrays(1, &m_cullVao); m_cullVao = 0; }
+    m_objectData.release();
+
+    GLuint buffers[4] = { m_cullBuffer, m_commandBuffer, m_indexBuffer, m_countBuffer };
+    for (GLuint buffer : buffers)
+    {
+        if (buffer) { glDeleteBuffers(1, &buffer); }
+    }
+    m_cullBuffer = m_commandBuffer = m_indexBuffer = m_countBuffer = 0;
+
+    m_objectCount = 0;
+    m_visibleCount = 0;
+    m_queried = false;
+}
+
+size_t GpuDrivenRenderer::build(const std::vector<DrawItem>& items)
+{
+    release();
+
+    // Indexed default-shader items drawing from an arena, grouped so that
+    // every group shares one VAO and one index type
+    struct Candidate
+    {
+        VertexArena* arena;
+        GLenum indexType;
+        unsigned int item;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const DrawItem& item = items[i];
+        if (item.shader != Shader::GetDefaultShader() || item.instanceCount != 0 || item.indexType == 0 || !item.layout)
+            continue;
+
+        VertexArena* arena = VertexArena::forVao(item.vao);
+        if (arena)
+        {
+            candidates.push_back({ arena, item.indexType, (unsigned int)i });
+        }
+    }
+    if (candidates.empty())
+        return 0;
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+    {
+        return a.arena != b.arena ? a.arena < b.arena : a.indexType < b.indexType;
+    });
+
+    std::vector<CullRecord> records(candidates.size());
+    std::vector<GLuint> objectIndices(candidates.size());
+
+    for (size_t k = 0; k < candidates.size(); ++k)
+    {
+        const Candidate& candidate = candidates[k];
+        const DrawItem& item = items[candidate.item];
+
+        if (m_groups.empty() || m_groups.back().arena != candidate.arena || m_groups.back().indexType != candidate.indexType)
+        {
+            Group group;
+            group.arena = candidate.arena;
+            group.indexType = candidate.indexType;
+            group.first = k;
+            m_groups.push_back(group);
+        }
+        m_groups.back().count++;
+
+        size_t indexSize = candidate.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        CullRecord& record = records[k];
+        for (int c = 0; c < 3; ++c)
+        {
+            record.boundsMin[c] = item.boundsMin[c];
+            record.boundsMax[c] = item.boundsMax[c];
+        }
+        record.command[0] = (GLuint)item.count;
+        record.command[1] = (GLuint)(item.indexOffset / indexSize);
+        record.command[2] = (GLuint)item.baseVertex;
+        record.command[3] = (GLuint)k;
+
+        objectIndices[k] = m_objectData.add(item);
+        m_items.push_back(candidate.item);
+    }
+
+    m_objectCount = candidates.size();
+    m_visibleCount = m_objectCount;
+    m_compact = GLEW_ARB_indirect_parameters && (GLEW_VERSION_4_4 || GLEW_ARB_query_buffer_object);
+
+    Shader* cull = Shader::GetCullShader();
+    for (int i = 0; i < 6; ++i)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "planes[%d]", i);
+        m_planeUniforms[i] = cull->getUniform<UNIFORM_VEC4>(name);
+    }
+    m_keepCulledUniform = cull->getUniform<UNIFORM_INT>("keepCulled");
+
+    glGenBuffers(1, &m_cullBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_cullBuffer);
+    glBufferData(GL_ARRAY_BUFFER, records.size() * sizeof(CullRecord), records.data(), GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &m_cullVao);
+    glBindVertexArray(m_cullVao);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CullRecord), (void*)offsetof(CullRecord, boundsMin));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(CullRecord), (void*)offsetof(CullRecord, boundsMax));
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(2, 4, GL_UNSIGNED_INT, sizeof(CullRecord), (void*)offsetof(CullRecord, command));
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &m_commandBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_commandBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_objectCount * COMMAND_SIZE, nullptr, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &m_indexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_indexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, objectIndices.size() * sizeof(GLuint), objectIndices.data(), GL_STATIC_DRAW);
+
+    if (m_compact)
+    {
+        glGenBuffers(1, &m_countBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, m_countBuffer);
+        glBufferData(GL_ARRAY_BUFFER, m_groups.size() * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    }
+
+    m_objectData.upload();
+
+    // Arena geometry plus the object index as an instanced attribute; with
+    // one instance per command, baseInstance selects the object
+    for (Group& group : m_groups)
+    {
+        if (m_compact)
+        {
+            glGenQueries(1, &group.query);
+        }
+
+        glGenVertexArrays(1, &group.vao);
+        glBindVertexArray(group.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, group.arena->getVertexBuffer());
+        setupVertexAttributes(group.arena->getLayout());
+        glBindBuffer(GL_ARRAY_BUFFER, m_indexBuffer);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(3, 1);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, group.arena->getIndexBuffer());
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    if (RenderObject::getLogResources())
+    {
+        printf("GpuDrivenRenderer::build: %u objects in %u groups, %u bytes of object data, %s\n",
+            (unsigned)m_objectCount,
+            (unsigned)m_groups.size(),
+            (unsigned)(m_objectData.size() * ObjectDataBuffer::TEXELS * 4 * sizeof(float)),
+            m_compact ? "compacted with GPU draw counts" : "culled commands kept");
+    }
+
+    return m_objectCount;
+}
+
+unsigned int GpuDrivenRenderer::hideItems(std::vector<DrawItem>& items) const
+{
+    unsigned int hidden = 0;
+    for (unsigned int index : m_items)
+    {
+        if (items[index].visible)
+        {
+            items[index].visible = false;
+            ++hidden;
+        }
+    }
+    return hidden;
+}
+
+void GpuDrivenRenderer::collectVisibleCount()
+{
+    if (!m_compact || !m_queried)
+        return;
+
+    for (const Group& group : m_groups)
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(group.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+    }
+
+    size_t visible = 0;
+    for (const Group& group : m_groups)
+    {
+        GLuint count = 0;
+        glGetQueryObjectuiv(group.query, GL_QUERY_RESULT, &count);
+        visible += count;
+    }
+    m_visibleCount = visible;
+}
+
+void GpuDrivenRenderer::render(const glm::mat4& projection, const glm::mat4& view)
+{
+    if (m_objectCount == 0)
+        return;
+
+    // Before the queries are reused below
+    collectVisibleCount();
+
+    glm::mat4 viewProjection = projection * view;
+    Frustum frustum;
+    frustum.extract(viewProjection);
+
+    // Culling pass: points in, indirect commands out, nothing rasterized
+    Shader* cull = Shader::GetCullShader();
+    cull->setCurrent();
+    for (int i = 0; i < 6; ++i)
+    {
+        float plane[4];
+        frustum.getPlane(i, plane);
+        cull->set(m_planeUniforms[i], plane);
+    }
+    cull->set(m_keepCulledUniform, m_compact ? 0 : 1);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(m_cullVao);
+    for (const Group& group : m_groups)
+    {
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_commandBuffer, group.first * COMMAND_SIZE, group.count * COMMAND_SIZE);
+        if (m_compact)
+            glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, group.query);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, (GLint)group.first, (GLsizei)group.count);
+        glEndTransformFeedback();
+        if (m_compact)
+            glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    }
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    // The counts go from the queries into m_countBuffer on the GPU; with a
+    // query buffer bound the "pointer" is an offset into it
+    if (m_compact)
+    {
+        glBindBuffer(GL_QUERY_BUFFER, m_countBuffer);
+        for (size_t g = 0; g < m_groups.size(); ++g)
+        {
+            glGetQueryObjectuiv(m_groups[g].query, GL_QUERY_RESULT, reinterpret_cast<GLuint*>(g * sizeof(GLuint)));
+        }
+        glBindBuffer(GL_QUERY_BUFFER, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, m_countBuffer);
+        m_queried = true;
+    }
+
+    // Draw pass: one multi-draw per group
+    Shader* shader = Shader::GetObjectDataShader();
+    shader->setCurrent();
+    shader->set(shader->getUniform<UNIFORM_MAT4>("viewProjection"), &viewProjection[0][0]);
+    shader->set(shader->getUniform<UNIFORM_MAT4>("view"), &view[0][0]);
+    shader->set(shader->getUniform<UNIFORM_INT>("objectData"), 0);
+
+    m_objectData.bind(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+
+    for (size_t g = 0; g < m_groups.size(); ++g)
+    {
+        const Group& group = m_groups[g];
+        const void* commands = reinterpret_cast<const void*>(group.first * COMMAND_SIZE);
+        glBindVertexArray(group.vao);
+        if (m_compact)
+        {
+            glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, group.indexType, commands, (GLintptr)(g * sizeof(GLuint)), (GLsizei)group.count, 0);
+        }
+        else
+        {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, group.indexType, commands, (GLsizei)group.count, 0);
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    if (m_compact)
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    Shader::GetDefaultShader()->setCurrent();
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "RenderQueue.h"
+#include "ObjectDataBuffer.h"
+#include "../gl/Shader.h"
+
+class VertexArena;
+
+/**
+ * GpuDrivenRenderer draws the static part of a RenderQueue with a few API
+ * calls per frame, independent of the object count.
+ *
+ * build() uploads, once per queue rebuild, the world bounds and draw
+ * parameters of every item that draws indexed geometry from a VertexArena
+ * with the default shader, plus its ObjectDataBuffer entry. Each frame a transform
+ * feedback pass culls all of them against the frustum and writes them as
+ * DrawElementsIndirectCommands; one multi-draw per (arena, index type) group
+ * then draws them. Nothing is read back on the CPU:
+ *
+ * - with ARB_indirect_parameters and query buffer objects only the visible
+ *   commands are written; primitive queries store the per-group counts in a
+ *   buffer that glMultiDrawElementsIndirectCountARB reads on the GPU
+ * - otherwise every command is written, culled ones with instanceCount 0,
+ *   and all of them are submitted
+ *
+ * Items taken over must be hidden from the regular submit with hideItems()
+ * after every CPU culling pass; everything else (instancing, impostors, procedural shapes) stays on the
+ * CPU path. Levels of detail are not applied on this path.
+ */
+class GpuDrivenRenderer
+{
+public:
+    GpuDrivenRenderer() {}
+    ~GpuDrivenRenderer();
+
+    // Multi-draw indirect with base instance, geometry shaders and buffer textures
+    static bool isSupported();
+
+    // Take over the eligible items; returns their number
+    size_t build(const std::vector<DrawItem>& items);
+
+    // Mark the items taken over invisible; returns how many were visible
+    unsigned int hideItems(std::vector<DrawItem>& items) const;
+
+    void render(const glm::mat4& projection, const glm::mat4& view);
+
+    void release();
+
+    size_t getObjectCount() const { return m_objectCount; }
+    // Objects that passed a recent culling pass, taken from the queries once
+    // the GPU has them (a frame or so late). Without compaction every object
+    // is counted, culled ones are drawn as empty commands.
+    size_t getVisibleCount() const { return m_visibleCount; }
+
+private:
+    struct Group
+    {
+        VertexArena* arena = nullptr;
+        GLenum indexType = 0;
+        GLuint vao = 0;       // arena buffers plus the object index attribute
+        GLuint query = 0;     // primitives written by the culling pass (compaction only)
+        size_t first = 0;     // first object of the group
+        size_t count = 0;
+    };
+
+    // Per object input of the culling pass
+    struct CullRecord
+    {
+        float boundsMin[3];
+        float boundsMax[3];
+        GLuint command[4]; // count, firstIndex, baseVertex, object index
+    };
+
+    std::vector<Group> m_groups;
+    std::vector<unsigned int> m_items; // queue indices of the objects, in object order
+    size_t m_objectCount = 0;
+    size_t m_visibleCount = 0;
+    bool m_compact = false;      // draw counts come from m_countBuffer
+    bool m_queried = false;      // the group queries have results pending or available
+
+    GLuint m_cullVao = 0;
+    GLuint m_cullBuffer = 0;     // CullRecord per object
+    GLuint m_commandBuffer = 0;  // transform feedback output, indirect draw input
+    GLuint m_indexBuffer = 0;    // 0 .. n-1, per-instance object index
+    GLuint m_countBuffer = 0;    // visible commands per group, written by the queries
+    ObjectDataBuffer m_objectData;
+    UniformVec4 m_planeUniforms[6]; // of the culling program
+    UniformInt m_keepCulledUniform;
+
+    // Visible counts of the last frame whose queries have finished; never waits
+    void collectVisibleCount();
+};
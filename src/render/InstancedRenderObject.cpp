@@ -0,0 +1,203 @@
+#include "InstancedRenderObject.h"
+#include "SceneGraph.h"
+#include "../gl/Shader.h"
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+
+static unsigned char toUnorm8(double v)
+{
+    if (v < 0.0) v = 0.0;
+    if (v > 1.0) v = 1.0;
+    return (unsigned char)std::floor(v * 255.0 + 0.5);
+}
+
+InstancedRenderObject::InstancedRenderObject(const std::string& name)
+    : RenderObject(name)
+{
+    // The instance attributes live in the VAO, so it cannot be the shared arena VAO
+    m_useVertexArena = false;
+}
+
+InstancedRenderObject::~InstancedRenderObject()
+{
+    if (m_instanceVbo) { glDeleteBuffers(1, &m_instanceVbo); m_instanceVbo = 0; }
+}
+
+InstancedRenderObject::InstanceData InstancedRenderObject::packInstance(const Instance& instance)
+{
+    InstanceData data;
+    data.offsetScale[0] = (float)instance.position.x;
+    data.offsetScale[1] = (float)instance.position.y;
+    data.offsetScale[2] = (float)instance.position.z;
+    data.offsetScale[3] = (float)instance.scale;
+    data.color[0] = toUnorm8(instance.color.x);
+    data.color[1] = toUnorm8(instance.color.y);
+    data.color[2] = toUnorm8(instance.color.z);
+    data.color[3] = 255;
+    data.objectID = instance.objectID;
+    return data;
+}
+
+size_t InstancedRenderObject::instanceBytes()
+{
+    return sizeof(InstanceData);
+}
+
+void InstancedRenderObject::addInstance(const Instance& instance)
+{
+    m_instances.push_back(instance);
+    if (m_instanceVbo != 0)
+    {
+        uploadInstances();
+    }
+    invalidateBounds();
+}
+
+void InstancedRenderObject::setInstance(size_t i, const Instance& instance)
+{
+    if (i >= m_instances.size())
+        return;
+
+    m_instances[i] = instance;
+    if (m_instanceVbo != 0)
+    {
+        // Only the changed record goes to the GPU
+        InstanceData data = packInstance(instance);
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+        glBufferSubData(GL_ARRAY_BUFFER, i * sizeof(InstanceData), sizeof(InstanceData), &data);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    invalidateBounds();
+}
+
+void InstancedRenderObject::clearInstances()
+{
+    m_instances.clear();
+    invalidateBounds();
+}
+
+bool InstancedRenderObject::computeLocalVolume(PointDouble3D& min, PointDouble3D& max) const
+{
+    PointDouble3D meshMin, meshMax;
+    if (m_instances.empty() || !m_mesh.getBounds(meshMin, meshMax))
+        return false;
+
+    for (size_t i = 0; i < m_instances.size(); ++i)
+    {
+        const Instance& instance = m_instances[i];
+        double s = std::fabs(instance.scale);
+        PointDouble3D lo(instance.position.x + meshMin.x * s, instance.position.y + meshMin.y * s, instance.position.z + meshMin.z * s);
+        PointDouble3D hi(instance.position.x + meshMax.x * s, instance.position.y + meshMax.y * s, instance.position.z + meshMax.z * s);
+        if (i == 0)
+        {
+            min = lo;
+            max = hi;
+            continue;
+        }
+
+        if (lo.x < min.x) min.x = lo.x;
+        if (lo.y < min.y) min.y = lo.y;
+        if (lo.z < min.z) min.z = lo.z;
+
+        if (hi.x > max.x) max.x = hi.x;
+        if (hi.y > max.y) max.y = hi.y;
+        if (hi.z > max.z) max.z = hi.z;
+    }
+    return true;
+}
+
+void InstancedRenderObject::buildGraphicsResources()
+{
+    RenderObject::buildGraphicsResources();
+
+    if (getRenderMethod() == RENDER_VAO && m_vao != 0)
+    {
+        uploadInstances();
+    }
+}
+
+void InstancedRenderObject::uploadInstances()
+{
+    std::vector<InstanceData> data;
+    data.reserve(m_instances.size());
+    for (const Instance& instance : m_instances)
+    {
+        data.push_back(packInstance(instance));
+    }
+
+    if (m_instanceVbo == 0)
+    {
+        glGenBuffers(1, &m_instanceVbo);
+        m_instanceCapacity = 0;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+    if (data.size() > m_instanceCapacity)
+    {
+        // grow geometrically so repeated addInstance() stays cheap
+        size_t capacity = std::max(data.size(), 2 * m_instanceCapacity);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+        m_instanceCapacity = capacity;
+    }
+    if (!data.empty())
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, data.size() * sizeof(InstanceData), data.data());
+    }
+
+    glBindVertexArray(m_vao);
+
+    GLsizei stride = (GLsizei)sizeof(InstanceData);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(InstanceData, offsetScale));
+    glVertexAttribDivisor(3, 1);
+
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(InstanceData, color));
+    glVertexAttribDivisor(4, 1);
+
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, stride, (void*)offsetof(InstanceData, objectID));
+    glVertexAttribDivisor(5, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    markChanged();
+}
+
+void InstancedRenderObject::collectDrawItems(std::vector<DrawItem>& items) const
+{
+    if (hasDrawResources() && !m_instances.empty())
+    {
+        DrawItem item = makeDrawItem();
+        if (getRenderMethod() == RENDER_VAO)
+        {
+            item.shader = Shader::GetInstancedShader();
+            item.instanceCount = (GLsizei)m_instances.size();
+        }
+        items.push_back(item);
+    }
+
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child)
+        {
+            child->collectDrawItems(items);
+        }
+    }
+}
+
+void InstancedRenderObject::renderGeometry() const
+{
+    glMatrixMode(GL_MODELVIEW);
+    for (const Instance& instance : m_instances)
+    {
+        glPushMatrix();
+        glTranslated(instance.position.x, instance.position.y, instance.position.z);
+        glScaled(instance.scale, instance.scale, instance.scale);
+        RenderObject::renderGeometry();
+        glPopMatrix();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "RenderObject.h"
+
+/**
+ * InstancedRenderObject draws one mesh many times with a single
+ * glDrawElementsInstanced/glDrawArraysInstanced call.
+ *
+ * Every instance has its own offset, uniform scale, color and object ID,
+ * stored in a per-instance vertex buffer (attributes 3..5, divisor 1). The
+ * instanced shader writes the instance ID into the selection attachment,
+ * so picking returns the ID of the instance under the cursor.
+ */
+class InstancedRenderObject : public RenderObject
+{
+public:
+    struct Instance
+    {
+        PointDouble3D position;
+        double scale = 1.0;
+        PointDouble3D color = PointDouble3D(1.0, 1.0, 1.0);
+        unsigned int objectID = 0;
+    };
+
+    InstancedRenderObject(const std::string& name);
+    virtual ~InstancedRenderObject();
+
+    void addInstance(const Instance& instance);
+    void setInstance(size_t i, const Instance& instance);
+    void clearInstances();
+
+    size_t getInstanceCount() const { return m_instances.size(); }
+    const Instance& getInstance(size_t i) const { return m_instances[i]; }
+
+    virtual void buildGraphicsResources() override;
+    virtual void collectDrawItems(std::vector<DrawItem>& items) const override;
+    virtual bool supportsLod() const override { return false; }
+
+    // Fixed-function fallback: one draw per instance, without per-instance colors
+    virtual void renderGeometry() const override;
+
+protected:
+    // Union of the mesh bounds placed at every instance
+    virtual bool computeLocalVolume(PointDouble3D& min, PointDouble3D& max) const override;
+
+    // (Re)create the instance buffer and hook it into m_vao
+    void uploadInstances();
+
+    // Size of one instance record on the GPU
+    static size_t instanceBytes();
+
+    std::vector<Instance> m_instances;
+
+private:
+    // GPU record of one instance, see the instanced shader in Shader.cpp
+    struct InstanceData
+    {
+        float offsetScale[4];
+        unsigned char color[4];
+        unsigned int objectID;
+    };
+
+    static InstanceData packInstance(const Instance& instance);
+
+    GLuint m_instanceVbo = 0;
+    size_t m_instanceCapacity = 0; // instances the buffer was allocated for
+};
@@ -0,0 +1,218 @@
+#include "MeshBuffer.h"
+#include "PointKernels.h"
+#include <GL/glew.h>
+#include <cstring>
+#include <cstdint>
+
+
+static_assert(sizeof(PointDouble3D) == 3 * sizeof(double), "PointDouble3D must be three packed doubles");
+
+static void assignTriples(std::vector<float>& out, const std::vector<PointDouble3D>& points)
+{
+    out.resize(points.size() * 3);
+    if (!points.empty())
+    {
+        PointKernels::convert(&points[0].x, out.data(), points.size() * 3);
+    }
+}
+
+void MeshBuffer::clear()
+{
+    m_positions.clear();
+    m_normals.clear();
+    m_texCoords.clear();
+    m_colors.clear();
+    m_indices.clear();
+}
+
+void MeshBuffer::resize(size_t vertexCount, bool withNormals, bool withTexCoords, bool withColors)
+{
+    m_positions.resize(vertexCount * 3);
+    m_normals.resize(withNormals ? vertexCount * 3 : 0);
+    m_texCoords.resize(withTexCoords ? vertexCount * 2 : 0);
+    m_colors.resize(withColors ? vertexCount * 3 : 0);
+}
+
+void MeshBuffer::reserve(size_t vertexCount, bool withNormals, bool withTexCoords, bool withColors)
+{
+    m_positions.reserve(vertexCount * 3);
+    if (withNormals) m_normals.reserve(vertexCount * 3);
+    if (withTexCoords) m_texCoords.reserve(vertexCount * 2);
+    if (withColors) m_colors.reserve(vertexCount * 3);
+}
+
+void MeshBuffer::setPositions(const std::vector<PointDouble3D>& positions)
+{
+    assignTriples(m_positions, positions);
+}
+
+void MeshBuffer::setNormals(const std::vector<PointDouble3D>& normals)
+{
+    assignTriples(m_normals, normals);
+}
+
+void MeshBuffer::setTexCoords(const std::vector<PointDouble3D>& texCoords)
+{
+    m_texCoords.resize(texCoords.size() * 2);
+    for (size_t i = 0; i < texCoords.size(); ++i)
+    {
+        m_texCoords[i * 2 + 0] = (float)texCoords[i].x;
+        m_texCoords[i * 2 + 1] = (float)texCoords[i].y;
+    }
+}
+
+void MeshBuffer::setColors(const std::vector<PointDouble3D>& colors)
+{
+    assignTriples(m_colors, colors);
+}
+
+void MeshBuffer::dropMismatchedAttributes()
+{
+    if (!hasNormals()) m_normals.clear();
+    if (!hasTexCoords()) m_texCoords.clear();
+    if (!hasColors()) m_colors.clear();
+}
+
+bool MeshBuffer::getBounds(PointDouble3D& min, PointDouble3D& max) const
+{
+    float lo[3], hi[3];
+    if (!PointKernels::minMax(m_positions.data(), vertexCount(), lo, hi))
+        return false;
+
+    min = PointDouble3D(lo[0], lo[1], lo[2]);
+    max = PointDouble3D(hi[0], hi[1], hi[2]);
+    return true;
+}
+
+size_t MeshBuffer::bytesPerVertex() const
+{
+    size_t floats = 3;
+    if (hasNormals()) floats += 3;
+    if (hasTexCoords()) floats += 2;
+    if (hasColors()) floats += 3;
+    return floats * sizeof(float);
+}
+
+size_t MeshBuffer::memoryBytes() const
+{
+    return (m_positions.size() + m_normals.size() + m_texCoords.size() + m_colors.size()) * sizeof(float)
+        + m_indices.size() * sizeof(unsigned int);
+}
+
+unsigned int MeshBuffer::indexType() const
+{
+    return vertexCount() <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+size_t MeshBuffer::indexSize() const
+{
+    return indexType() == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+// Gather the attributes of one vertex as raw bits; -0.0 is folded into 0.0
+// so that vertices differing only in the sign of zero are merged.
+static size_t gatherVertex(const MeshBuffer& mesh, size_t i, uint32_t key[11])
+{
+    size_t n = 0;
+    auto append = [&](const float* src, size_t count) {
+        for (size_t k = 0; k < count; ++k)
+        {
+            float f = src[k] == 0.0f ? 0.0f : src[k];
+            std::memcpy(&key[n++], &f, sizeof(float));
+        }
+    };
+
+    append(mesh.positions() + i * 3, 3);
+    if (mesh.hasNormals()) append(mesh.normals() + i * 3, 3);
+    if (mesh.hasTexCoords()) append(mesh.texCoords() + i * 2, 2);
+    if (mesh.hasColors()) append(mesh.colors() + i * 3, 3);
+    return n;
+}
+
+static uint32_t hashVertex(const uint32_t* key, size_t n)
+{
+    // FNV-1a over the attribute words
+    uint32_t h = 2166136261u;
+    for (size_t k = 0; k < n; ++k)
+    {
+        h ^= key[k];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+size_t MeshBuffer::weld()
+{
+    size_t count = vertexCount();
+    if (count == 0)
+        return 0;
+
+    bool normals = hasNormals();
+    bool texCoords = hasTexCoords();
+    bool colors = hasColors();
+
+    // Open addressing table of unique vertex slots, sized to a power of two
+    size_t tableSize = 1;
+    while (tableSize < count * 2) tableSize <<= 1;
+    const unsigned int empty = ~0u;
+    std::vector<unsigned int> table(tableSize, empty);
+
+    std::vector<unsigned int> remap(count);
+    MeshBuffer unique;
+    unique.reserve(count, normals, texCoords, colors);
+
+    uint32_t key[11];
+    uint32_t other[11];
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t n = gatherVertex(*this, i, key);
+        size_t slot = hashVertex(key, n) & (tableSize - 1);
+        for (;;)
+        {
+            unsigned int candidate = table[slot];
+            if (candidate == empty)
+            {
+                unsigned int newIndex = (unsigned int)unique.vertexCount();
+                table[slot] = (unsigned int)i;
+                remap[i] = newIndex;
+
+                unique.m_positions.insert(unique.m_positions.end(), m_positions.begin() + i * 3, m_positions.begin() + i * 3 + 3);
+                if (normals) unique.m_normals.insert(unique.m_normals.end(), m_normals.begin() + i * 3, m_normals.begin() + i * 3 + 3);
+                if (texCoords) unique.m_texCoords.insert(unique.m_texCoords.end(), m_texCoords.begin() + i * 2, m_texCoords.begin() + i * 2 + 2);
+                if (colors) unique.m_colors.insert(unique.m_colors.end(), m_colors.begin() + i * 3, m_colors.begin() + i * 3 + 3);
+                break;
+            }
+
+            gatherVertex(*this, candidate, other);
+            if (std::memcmp(key, other, n * sizeof(uint32_t)) == 0)
+            {
+                remap[i] = remap[candidate];
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    // Rebuild the index array in terms of the unique vertices
+    std::vector<unsigned int> indices;
+    if (isIndexed())
+    {
+        indices.resize(m_indices.size());
+        for (size_t i = 0; i < m_indices.size(); ++i)
+        {
+            indices[i] = remap[m_indices[i]];
+        }
+    }
+    else
+    {
+        indices.swap(remap);
+    }
+
+    size_t removed = count - unique.vertexCount();
+    m_positions.swap(unique.m_positions);
+    m_normals.swap(unique.m_normals);
+    m_texCoords.swap(unique.m_texCoords);
+    m_colors.swap(unique.m_colors);
+    m_indices.swap(indices);
+    return removed;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "Point3D.h"
+
+/**
+ * MeshBuffer holds the CPU copy of a mesh as tightly packed float arrays,
+ * one array per attribute (structure-of-arrays).
+ *
+ * Positions are mandatory (3 floats per vertex). Normals (3 floats),
+ * texture coordinates (2 floats) and colors (3 floats) are optional and
+ * simply stay empty when a mesh does not carry them.
+ *
+ * A mesh is either a plain triangle list (every 3 vertices form a triangle)
+ * or indexed, in which case every 3 entries of the index array do.
+ */
+class MeshBuffer
+{
+public:
+    MeshBuffer() {}
+
+    void clear();
+
+    // Resize every present attribute to hold vertexCount vertices
+    void resize(size_t vertexCount, bool withNormals, bool withTexCoords, bool withColors);
+    void reserve(size_t vertexCount, bool withNormals, bool withTexCoords, bool withColors);
+
+    size_t vertexCount() const { return m_positions.size() / 3; }
+    bool empty() const { return m_positions.empty(); }
+
+    // Number of vertices the mesh draws: index count when indexed, vertex count otherwise
+    size_t elementCount() const { return isIndexed() ? m_indices.size() : vertexCount(); }
+    size_t triangleCount() const { return elementCount() / 3; }
+
+    bool hasNormals() const { return !m_normals.empty() && m_normals.size() == m_positions.size(); }
+    bool hasTexCoords() const { return !m_texCoords.empty() && m_texCoords.size() / 2 == vertexCount(); }
+    bool hasColors() const { return !m_colors.empty() && m_colors.size() == m_positions.size(); }
+
+    // Append a single vertex; optional attributes are only written when present
+    void addPosition(float x, float y, float z) { m_positions.push_back(x); m_positions.push_back(y); m_positions.push_back(z); }
+    void addNormal(float x, float y, float z) { m_normals.push_back(x); m_normals.push_back(y); m_normals.push_back(z); }
+    void addTexCoord(float u, float v) { m_texCoords.push_back(u); m_texCoords.push_back(v); }
+    void addColor(float r, float g, float b) { m_colors.push_back(r); m_colors.push_back(g); m_colors.push_back(b); }
+
+    // Conversion from the double-precision point lists used by the public RenderObject API
+    void setPositions(const std::vector<PointDouble3D>& positions);
+    void setNormals(const std::vector<PointDouble3D>& normals);
+    void setTexCoords(const std::vector<PointDouble3D>& texCoords); // only x, y are kept
+    void setColors(const std::vector<PointDouble3D>& colors);
+
+    void clearIndices() { m_indices.clear(); }
+    void clearNormals() { m_normals.clear(); }
+    void clearTexCoords() { m_texCoords.clear(); }
+    void clearColors() { m_colors.clear(); }
+
+    // Drop optional attributes whose element count does not match the positions
+    void dropMismatchedAttributes();
+
+    // Indexed geometry
+    bool isIndexed() const { return !m_indices.empty(); }
+    void setIndices(const std::vector<unsigned int>& indices) { m_indices = indices; }
+    void addTriangle(unsigned int a, unsigned int b, unsigned int c) { m_indices.push_back(a); m_indices.push_back(b); m_indices.push_back(c); }
+    std::vector<unsigned int>& indices() { return m_indices; }
+    const std::vector<unsigned int>& indices() const { return m_indices; }
+
+    // Index of the vertex used by the given element (identity for triangle lists)
+    unsigned int vertexIndex(size_t element) const { return isIndexed() ? m_indices[element] : (unsigned int)element; }
+
+    // Merge vertices whose attributes are bitwise identical and rebuild the
+    // index array. Works on both triangle soups and already indexed meshes.
+    // Returns the number of vertices removed.
+    size_t weld();
+
+    // Smallest GL index type able to address every vertex (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT)
+    unsigned int indexType() const;
+    size_t indexSize() const;
+
+    PointFloat3D position(size_t i) const { return PointFloat3D(m_positions[i * 3], m_positions[i * 3 + 1], m_positions[i * 3 + 2]); }
+    PointFloat3D normal(size_t i) const { return PointFloat3D(m_normals[i * 3], m_normals[i * 3 + 1], m_normals[i * 3 + 2]); }
+    PointFloat3D color(size_t i) const { return PointFloat3D(m_colors[i * 3], m_colors[i * 3 + 1], m_colors[i * 3 + 2]); }
+
+    float* positions() { return m_positions.data(); }
+    float* normals() { return m_normals.data(); }
+    float* texCoords() { return m_texCoords.data(); }
+    float* colors() { return m_colors.data(); }
+    const float* positions() const { return m_positions.data(); }
+    const float* normals() const { return m_normals.data(); }
+    const float* texCoords() const { return m_texCoords.data(); }
+    const float* colors() const { return m_colors.data(); }
+
+    // Axis aligned bounds of the positions; returns false for an empty mesh
+    bool getBounds(PointDouble3D& min, PointDouble3D& max) const;
+
+    // Memory accounting for the attributes currently present
+    size_t bytesPerVertex() const;
+    size_t memoryBytes() const;
+
+private:
+    std::vector<float> m_positions; // x, y, z
+    std::vector<float> m_normals;   // x, y, z
+    std::vector<float> m_texCoords; // u, v
+    std::vector<float> m_colors;    // r, g, b
+
+    std::vector<unsigned int> m_indices; // 3 per triangle, empty for a plain triangle list
+};
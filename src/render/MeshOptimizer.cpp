@@ -0,0 +1,450 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+
+namespace
+{
+    // Forsyth, "Linear-Speed Vertex Cache Optimisation"
+    const unsigned int FORSYTH_CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    // Clusters shorter than this are not worth a soft split
+    const size_t MIN_CLUSTER_TRIANGLES = 16;
+
+    const unsigned int INVALID = ~0u;
+
+    float vertexScore(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+            {
+                // The triangle just emitted: its vertices are in the cache
+                // whatever the order, so do not favour one of them
+                score = LAST_TRIANGLE_SCORE;
+            }
+            else
+            {
+                float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+            }
+        }
+
+        // Vertices with few triangles left get a boost so they are finished off
+        score += VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+        return score;
+    }
+
+    // FIFO cache model: a vertex is cached while fewer than cacheSize
+    // misses happened since it was last transformed
+    struct FifoCache
+    {
+        std::vector<unsigned int> timestamps;
+        unsigned int time;
+        unsigned int size;
+
+        FifoCache(size_t vertexCount, unsigned int cacheSize)
+            : timestamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+        void reset() { time += size + 1; }
+
+        // Returns 1 on a miss
+        unsigned int access(unsigned int v)
+        {
+            if (time - timestamps[v] > size)
+            {
+                timestamps[v] = time++;
+                return 1;
+            }
+            return 0;
+        }
+    };
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    CacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (unsigned int v : indices)
+    {
+        misses += cache.access(v);
+    }
+
+    stats.acmr = (double)misses / (double)(indices.size() / 3);
+    stats.atvr = (double)misses / (double)vertexCount;
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Vertex -> triangle adjacency; the first liveTriangles[v] entries of a
+    // vertex's range are the triangles not emitted yet
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (unsigned int v : indices)
+    {
+        liveTriangles[v]++;
+    }
+
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        offsets[v + 1] = offsets[v] + liveTriangles[v];
+    }
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        vertexScores[v] = vertexScore(-1, liveTriangles[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    unsigned int current = 0;
+    size_t cursor = 0;
+    while (current != INVALID)
+    {
+        const unsigned int* tri = &indices[current * 3];
+        output.insert(output.end(), tri, tri + 3);
+        emitted[current] = true;
+
+        newCache.clear();
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int v = tri[k];
+
+            unsigned int* begin = &adjacency[offsets[v]];
+            unsigned int* end = begin + liveTriangles[v];
+            unsigned int* it = std::find(begin, end, current);
+            if (it != end)
+            {
+                *it = *(end - 1);
+                *(end - 1) = current;
+                liveTriangles[v]--;
+            }
+
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        for (unsigned int v : cache)
+        {
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        // Vertices pushed out of the cache lose their cache score
+        for (size_t i = 0; i < newCache.size(); ++i)
+        {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+            vertexScores[v] = vertexScore(cachePosition[v], liveTriangles[v]);
+        }
+
+        // Best candidate among the triangles touching the cache
+        unsigned int best = INVALID;
+        float bestScore = -1.0f;
+        for (unsigned int v : newCache)
+        {
+            for (unsigned int a = offsets[v]; a < offsets[v] + liveTriangles[v]; ++a)
+            {
+                unsigned int t = adjacency[a];
+                float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                triangleScores[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+
+        if (newCache.size() > FORSYTH_CACHE_SIZE)
+        {
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(newCache);
+
+        if (best == INVALID)
+        {
+            // Nothing connected to the cache is left: restart from the next unused triangle
+            while (cursor < triangleCount && emitted[cursor])
+            {
+                ++cursor;
+            }
+            best = cursor < triangleCount ? (unsigned int)cursor : INVALID;
+        }
+
+        current = best;
+    }
+
+    indices.swap(output);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const float* positions, size_t vertexCount, double threshold)
+{
+    // Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality
+    // and Reduced Overdraw": cut the cache optimized order into clusters,
+    // then draw the clusters facing away from the mesh center first
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < MIN_CLUSTER_TRIANGLES * 2)
+        return;
+
+    const unsigned int cacheSize = 16;
+
+    // Hard boundaries: the cache order restarts where a triangle shares no
+    // vertex with the cache, moving that run costs nothing
+    std::vector<size_t> hard;
+    {
+        FifoCache cache(vertexCount, cacheSize);
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            unsigned int misses = cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+            if (misses == 3 || t == 0)
+            {
+                hard.push_back(t);
+            }
+        }
+        hard.push_back(triangleCount);
+    }
+
+    // Soft boundaries: split a hard cluster further wherever restarting the
+    // cache keeps the ACMR within threshold of the cluster's own
+    std::vector<size_t> clusters;
+    {
+        FifoCache cache(vertexCount, cacheSize);
+        for (size_t h = 0; h + 1 < hard.size(); ++h)
+        {
+            size_t begin = hard[h];
+            size_t end = hard[h + 1];
+
+            cache.reset();
+            size_t clusterMisses = 0;
+            for (size_t t = begin; t < end; ++t)
+            {
+                clusterMisses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+            }
+            double targetAcmr = threshold * (double)clusterMisses / (double)(end - begin);
+
+            cache.reset();
+            clusters.push_back(begin);
+            size_t misses = 0;
+            size_t start = begin;
+            for (size_t t = begin; t < end; ++t)
+            {
+                misses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+
+                size_t count = t + 1 - start;
+                if (count >= MIN_CLUSTER_TRIANGLES && end - (t + 1) >= MIN_CLUSTER_TRIANGLES &&
+                    (double)misses / (double)count <= targetAcmr)
+                {
+                    clusters.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    cache.reset();
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+    }
+
+    size_t clusterCount = clusters.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    // Area weighted centroid and normal of every cluster and of the mesh
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<float> centroids(clusterCount * 3);
+    std::vector<float> normals(clusterCount * 3);
+    double meshCentroid[3] = { 0.0, 0.0, 0.0 };
+    double meshArea = 0.0;
+
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        double center[3] = { 0.0, 0.0, 0.0 };
+        double normal[3] = { 0.0, 0.0, 0.0 };
+        double area = 0.0;
+
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+        {
+            const float* p0 = positions + indices[t * 3] * 3;
+            const float* p1 = positions + indices[t * 3 + 1] * 3;
+            const float* p2 = positions + indices[t * 3 + 2] * 3;
+
+            double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            double a = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (int k = 0; k < 3; ++k)
+            {
+                center[k] += (p0[k] + p1[k] + p2[k]) * a / 3.0;
+                normal[k] += n[k];
+            }
+            area += a;
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            meshCentroid[k] += center[k];
+            centroids[c * 3 + k] = (float)(area > 0.0 ? center[k] / area : 0.0);
+        }
+        meshArea += area;
+
+        double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (int k = 0; k < 3; ++k)
+        {
+            normals[c * 3 + k] = (float)(length > 0.0 ? normal[k] / length : 0.0);
+        }
+    }
+
+    if (meshArea > 0.0)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            meshCentroid[k] /= meshArea;
+        }
+    }
+
+    // Clusters far out along their own normal are likely to occlude the
+    // rest of the mesh from any direction they are visible from
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        float key = 0.0f;
+        for (int k = 0; k < 3; ++k)
+        {
+            key += (float)(centroids[c * 3 + k] - meshCentroid[k]) * normals[c * 3 + k];
+        }
+        sortKeys[c] = key;
+    }
+
+    std::vector<unsigned int> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        order[c] = (unsigned int)c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](unsigned int a, unsigned int b)
+    {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (unsigned int c : order)
+    {
+        output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+    indices.swap(output);
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshBuffer& mesh)
+{
+    if (!mesh.isIndexed())
+        return;
+
+    // New vertex numbers in order of first use; unreferenced vertices are dropped
+    size_t vertexCount = mesh.vertexCount();
+    std::vector<unsigned int> remap(vertexCount, INVALID);
+    std::vector<unsigned int> indices = mesh.indices();
+    unsigned int next = 0;
+    for (unsigned int& v : indices)
+    {
+        if (remap[v] == INVALID)
+        {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+
+    bool withNormals = mesh.hasNormals();
+    bool withTexCoords = mesh.hasTexCoords();
+    bool withColors = mesh.hasColors();
+
+    MeshBuffer result;
+    result.resize(next, withNormals, withTexCoords, withColors);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        unsigned int r = remap[v];
+        if (r == INVALID)
+            continue;
+
+        std::copy(mesh.positions() + v * 3, mesh.positions() + v * 3 + 3, result.positions() + r * 3);
+        if (withNormals)
+            std::copy(mesh.normals() + v * 3, mesh.normals() + v * 3 + 3, result.normals() + r * 3);
+        if (withTexCoords)
+            std::copy(mesh.texCoords() + v * 2, mesh.texCoords() + v * 2 + 2, result.texCoords() + r * 2);
+        if (withColors)
+            std::copy(mesh.colors() + v * 3, mesh.colors() + v * 3 + 3, result.colors() + r * 3);
+    }
+    result.setIndices(indices);
+
+    mesh = result;
+}
+
+void MeshOptimizer::optimize(MeshBuffer& mesh, const char* name)
+{
+    if (!mesh.isIndexed() || mesh.empty())
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    CacheStats before = analyzeVertexCache(mesh.indices(), mesh.vertexCount());
+
+    optimizeVertexCache(mesh.indices(), mesh.vertexCount());
+    optimizeOverdraw(mesh.indices(), mesh.positions(), mesh.vertexCount());
+    optimizeVertexFetch(mesh);
+
+    CacheStats after = analyzeVertexCache(mesh.indices(), mesh.vertexCount());
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (name)
+    {
+        printf("MeshOptimizer(%s): %u triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %.3f ms\n",
+            name,
+            (unsigned)mesh.triangleCount(),
+            before.acmr, after.acmr,
+            before.atvr, after.atvr,
+            elapsedMs);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "MeshBuffer.h"
+
+/**
+ * Reordering passes for indexed meshes, run before upload.
+ *
+ * - optimizeVertexCache: triangle order for post-transform cache reuse
+ *   (Forsyth's linear-speed algorithm, LRU cache model)
+ * - optimizeOverdraw: reorders the cache-friendly triangle runs so
+ *   outward facing clusters are drawn first, reducing shaded fragments
+ *   that are later overwritten
+ * - optimizeVertexFetch: renumbers vertices in first-use order so vertex
+ *   fetches walk memory linearly
+ *
+ * None of them changes the geometry, only the order of triangles and vertices.
+ */
+class MeshOptimizer
+{
+public:
+    struct CacheStats
+    {
+        double acmr = 0.0; // transformed vertices per triangle (0.5 ideal, 3 worst)
+        double atvr = 0.0; // transformed vertices per vertex (1 ideal)
+    };
+
+    // Simulate a FIFO post-transform cache of cacheSize entries
+    static CacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+    static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+    // threshold: ACMR a soft cluster split may reach, relative to the cluster it splits
+    static void optimizeOverdraw(std::vector<unsigned int>& indices, const float* positions, size_t vertexCount, double threshold = 1.05);
+
+    static void optimizeVertexFetch(MeshBuffer& mesh);
+
+    // All three passes; prints ACMR/ATVR before and after when name is not null
+    static void optimize(MeshBuffer& mesh, const char* name = nullptr);
+};
@@ -0,0 +1,439 @@
+#include "MeshSimplifier.h"
+#include "RenderObject.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+
+// Symmetric 4x4 matrix of the plane equations around a vertex
+struct Quadric
+{
+    double a[10] = {}; // xx xy xz xw yy yz yw zz zw ww
+
+    void addPlane(double x, double y, double z, double w)
+    {
+        a[0] += x * x; a[1] += x * y; a[2] += x * z; a[3] += x * w;
+        a[4] += y * y; a[5] += y * z; a[6] += y * w;
+        a[7] += z * z; a[8] += z * w;
+        a[9] += w * w;
+    }
+
+    void add(const Quadric& q)
+    {
+        for (int i = 0; i < 10; ++i)
+            a[i] += q.a[i];
+    }
+
+    // Sum of squared distances of p to all planes
+    double evaluate(const float* p) const
+    {
+        double x = p[0], y = p[1], z = p[2];
+        return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+             + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+             + a[7] * z * z + 2.0 * a[8] * z
+             + a[9];
+    }
+};
+
+struct Collapse
+{
+    double cost;
+    unsigned int from;
+    unsigned int to;
+    unsigned int fromVersion;
+    unsigned int toVersion;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+static void triangleNormal(const float* a, const float* b, const float* c, double n[3])
+{
+    double ux = b[0] - a[0], uy = b[1] - a[1], uz = b[2] - a[2];
+    double vx = c[0] - a[0], vy = c[1] - a[1], vz = c[2] - a[2];
+    n[0] = uy * vz - uz * vy;
+    n[1] = uz * vx - ux * vz;
+    n[2] = ux * vy - uy * vx;
+}
+
+static uint64_t edgeKey(unsigned int a, unsigned int b)
+{
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+MeshSimplifier::Result MeshSimplifier::simplify(const MeshBuffer& input, MeshBuffer& output, size_t targetTriangles, double maxError)
+{
+    MeshBuffer mesh = input;
+    mesh.dropMismatchedAttributes();
+    if (!mesh.isIndexed())
+    {
+        mesh.weld();
+    }
+    if (!mesh.isIndexed())
+    {
+        for (unsigned int i = 0; i < (unsigned int)mesh.vertexCount(); ++i)
+        {
+            mesh.indices().push_back(i);
+        }
+    }
+
+    const float* positions = mesh.positions();
+    std::vector<unsigned int> indices = mesh.indices();
+    size_t vertexCount = mesh.vertexCount();
+    size_t triangleCount = indices.size() / 3;
+
+    // Vertices sharing a position (attribute seams) form one group
+    std::vector<unsigned int> order(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        order[i] = (unsigned int)i;
+    std::sort(order.begin(), order.end(), [positions](unsigned int a, unsigned int b)
+    {
+        return std::memcmp(positions + a * 3, positions + b * 3, 3 * sizeof(float)) < 0;
+    });
+
+    std::vector<unsigned int> group(vertexCount);
+    std::vector<unsigned int> groupSize;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        if (i == 0 || std::memcmp(positions + order[i] * 3, positions + order[i - 1] * 3, 3 * sizeof(float)) != 0)
+        {
+            groupSize.push_back(0);
+        }
+        group[order[i]] = (unsigned int)groupSize.size() - 1;
+        groupSize.back()++;
+    }
+
+    // Seam vertices and vertices on open or non-manifold edges stay in place
+    std::vector<unsigned char> lockedGroup(groupSize.size(), 0);
+    for (size_t g = 0; g < groupSize.size(); ++g)
+    {
+        lockedGroup[g] = groupSize[g] > 1;
+    }
+
+    std::unordered_map<uint64_t, unsigned int> edgeUse;
+    edgeUse.reserve(triangleCount * 3);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int a = group[indices[t * 3 + k]];
+            unsigned int b = group[indices[t * 3 + (k + 1) % 3]];
+            edgeUse[edgeKey(a, b)]++;
+        }
+    }
+    for (const auto& edge : edgeUse)
+    {
+        if (edge.second != 2)
+        {
+            lockedGroup[(unsigned int)(edge.first >> 32)] = 1;
+            lockedGroup[(unsigned int)(edge.first & 0xFFFFFFFFu)] = 1;
+        }
+    }
+
+    // Unit plane of every triangle added to its corners' quadrics, so a
+    // quadric evaluates to a sum of squared distances
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<std::vector<unsigned int>> vertexTriangles(vertexCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const unsigned int* tri = &indices[t * 3];
+        double n[3];
+        triangleNormal(positions + tri[0] * 3, positions + tri[1] * 3, positions + tri[2] * 3, n);
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0)
+        {
+            n[0] /= length; n[1] /= length; n[2] /= length;
+            const float* p = positions + tri[0] * 3;
+            double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+            for (int k = 0; k < 3; ++k)
+            {
+                quadrics[tri[k]].addPlane(n[0], n[1], n[2], d);
+            }
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            vertexTriangles[tri[k]].push_back((unsigned int)t);
+        }
+    }
+
+    std::vector<unsigned char> locked(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        locked[v] = lockedGroup[group[v]];
+    }
+
+    std::vector<unsigned char> removed(vertexCount, 0);
+    std::vector<unsigned char> deadTriangle(triangleCount, 0);
+    std::vector<unsigned int> version(vertexCount, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+    auto pushCollapse = [&](unsigned int from, unsigned int to)
+    {
+        if (locked[from] || from == to)
+            return;
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        Collapse c;
+        c.cost = std::max(0.0, q.evaluate(positions + to * 3));
+        c.from = from;
+        c.to = to;
+        c.fromVersion = version[from];
+        c.toVersion = version[to];
+        heap.push(c);
+    };
+
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int a = indices[t * 3 + k];
+            unsigned int b = indices[t * 3 + (k + 1) % 3];
+            pushCollapse(a, b);
+            pushCollapse(b, a);
+        }
+    }
+
+    double maxCost = maxError * maxError;
+    double worstCost = 0.0;
+    size_t liveTriangles = triangleCount;
+    std::vector<unsigned int> neighbours;
+
+    while (liveTriangles > targetTriangles && !heap.empty())
+    {
+        Collapse c = heap.top();
+        heap.pop();
+
+        unsigned int v = c.from;
+        unsigned int u = c.to;
+        if (removed[v] || removed[u] || c.fromVersion != version[v] || c.toVersion != version[u])
+            continue;
+        if (c.cost > maxCost)
+            break;
+
+        // Link condition: v and u may only share the vertices opposite their edge
+        neighbours.clear();
+        for (unsigned int t : vertexTriangles[v])
+        {
+            if (deadTriangle[t]) continue;
+            for (int k = 0; k < 3; ++k)
+                neighbours.push_back(indices[t * 3 + k]);
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+        size_t shared = 0;
+        std::vector<unsigned int> uNeighbours;
+        for (unsigned int t : vertexTriangles[u])
+        {
+            if (deadTriangle[t]) continue;
+            for (int k = 0; k < 3; ++k)
+                uNeighbours.push_back(indices[t * 3 + k]);
+        }
+        std::sort(uNeighbours.begin(), uNeighbours.end());
+        uNeighbours.erase(std::unique(uNeighbours.begin(), uNeighbours.end()), uNeighbours.end());
+        for (unsigned int w : uNeighbours)
+        {
+            if (w != u && w != v && std::binary_search(neighbours.begin(), neighbours.end(), w))
+                shared++;
+        }
+        if (shared > 2)
+            continue;
+
+        // Reject collapses that flip or degenerate a remaining triangle
+        bool valid = true;
+        for (unsigned int t : vertexTriangles[v])
+        {
+            if (deadTriangle[t]) continue;
+            const unsigned int* tri = &indices[t * 3];
+            if (tri[0] == u || tri[1] == u || tri[2] == u) continue;
+
+            const float* p[3];
+            const float* q[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] = positions + tri[k] * 3;
+                q[k] = tri[k] == v ? positions + u * 3 : p[k];
+            }
+            double before[3], after[3];
+            triangleNormal(p[0], p[1], p[2], before);
+            triangleNormal(q[0], q[1], q[2], after);
+            double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            double afterLength2 = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+            double beforeLength2 = before[0] * before[0] + before[1] * before[1] + before[2] * before[2];
+            if (dot <= 0.0 || afterLength2 <= 1e-12 * beforeLength2)
+            {
+                valid = false;
+                break;
+            }
+        }
+        if (!valid)
+            continue;
+
+        for (unsigned int t : vertexTriangles[v])
+        {
+            if (deadTriangle[t]) continue;
+            unsigned int* tri = &indices[t * 3];
+            if (tri[0] == u || tri[1] == u || tri[2] == u)
+            {
+                deadTriangle[t] = 1;
+                liveTriangles--;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                if (tri[k] == v)
+                    tri[k] = u;
+            }
+            vertexTriangles[u].push_back(t);
+        }
+
+        quadrics[u].add(quadrics[v]);
+        removed[v] = 1;
+        version[u]++;
+        worstCost = std::max(worstCost, c.cost);
+
+        for (unsigned int t : vertexTriangles[u])
+        {
+            if (deadTriangle[t]) continue;
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int w = indices[t * 3 + k];
+                if (w == u) continue;
+                pushCollapse(u, w);
+                pushCollapse(w, u);
+            }
+        }
+    }
+
+    // Compact the surviving vertices in order of first use
+    output.clear();
+    bool hasNormals = mesh.hasNormals();
+    bool hasTexCoords = mesh.hasTexCoords();
+    bool hasColors = mesh.hasColors();
+    std::vector<unsigned int> remap(vertexCount, ~0u);
+    std::vector<unsigned int>& outIndices = output.indices();
+    outIndices.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        if (deadTriangle[t]) continue;
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (remap[v] == ~0u)
+            {
+                remap[v] = (unsigned int)output.vertexCount();
+                const float* p = positions + v * 3;
+                output.addPosition(p[0], p[1], p[2]);
+                if (hasNormals)
+                {
+                    const float* n = mesh.normals() + v * 3;
+                    output.addNormal(n[0], n[1], n[2]);
+                }
+                if (hasTexCoords)
+                {
+                    const float* uv = mesh.texCoords() + v * 2;
+                    output.addTexCoord(uv[0], uv[1]);
+                }
+                if (hasColors)
+                {
+                    const float* col = mesh.colors() + v * 3;
+                    output.addColor(col[0], col[1], col[2]);
+                }
+            }
+            outIndices.push_back(remap[v]);
+        }
+    }
+
+    Result result;
+    result.triangles = liveTriangles;
+    result.maxError = std::sqrt(worstCost);
+    return result;
+}
+
+std::vector<MeshSimplifier::Level> MeshSimplifier::generateLods(const MeshBuffer& mesh, const LodSettings& settings)
+{
+    std::vector<Level> levels;
+    PointDouble3D min, max;
+    if (mesh.triangleCount() < settings.minTriangles || !mesh.getBounds(min, max))
+        return levels;
+
+    double diagonal = std::sqrt((max.x - min.x) * (max.x - min.x) + (max.y - min.y) * (max.y - min.y) + (max.z - min.z) * (max.z - min.z));
+    double radius = 0.5 * diagonal;
+    double errorBudget = settings.maxRelativeError * diagonal;
+
+    // levels must not reallocate, current points into it
+    levels.reserve(settings.maxLevels);
+    const MeshBuffer* current = &mesh;
+    double error = 0.0;
+    double switchSize = 1e30;
+    for (unsigned int i = 0; i < settings.maxLevels && error < errorBudget; ++i)
+    {
+        size_t currentTriangles = current->triangleCount();
+        size_t target = (size_t)(currentTriangles * settings.reduction);
+
+        Level level;
+        Result result = simplify(*current, level.mesh, target, errorBudget - error);
+        if (result.triangles > currentTriangles * 9 / 10)
+            break;
+
+        // Errors of cascaded levels add up; the sum stays within the budget
+        error += result.maxError;
+        level.error = error;
+        switchSize = std::min(switchSize, error > 0.0 ? settings.pixelError * 2.0 * radius / error : 1e30);
+        level.switchSize = switchSize;
+
+        levels.push_back(level);
+        current = &levels.back().mesh;
+    }
+    return levels;
+}
+
+size_t MeshSimplifier::generateLods(const std::vector<RenderObject*>& objects, const LodSettings& settings)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Levels inherit the normals of the base mesh, so create them up front,
+    // on the welded mesh
+    for (RenderObject* object : objects)
+    {
+        if (object && object->supportsLod() && object->getLodCount() == 1 &&
+            !object->getMesh().empty() && !object->getMesh().hasNormals())
+        {
+            object->weldMesh();
+            object->createDefaultNormal();
+        }
+    }
+
+    // Workers only read the meshes; the results are attached on this thread
+    std::vector<std::vector<Level>> results(objects.size());
+    ThreadPool::global().parallelFor(0, objects.size(), [&](size_t i)
+    {
+        const RenderObject* object = objects[i];
+        if (object && object->supportsLod() && object->getLodCount() == 1)
+        {
+            results[i] = generateLods(object->getMesh(), settings);
+        }
+    });
+
+    size_t added = 0;
+    size_t meshes = 0;
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        for (const Level& level : results[i])
+        {
+            objects[i]->addLod(level.mesh, level.switchSize);
+            added++;
+        }
+        if (!results[i].empty())
+            meshes++;
+    }
+
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("MeshSimplifier::generateLods: %u levels for %u of %u meshes on %u threads, %.1f ms\n",
+        (unsigned)added, (unsigned)meshes, (unsigned)objects.size(), ThreadPool::global().getThreadCount(), elapsedMs);
+    return added;
+}
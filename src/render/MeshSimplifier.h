@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "MeshBuffer.h"
+
+class RenderObject;
+
+/**
+ * Quadric error metric mesh simplification (Garland/Heckbert) by half-edge
+ * collapse.
+ *
+ * Every vertex accumulates the planes of its adjacent triangles; collapsing
+ * v onto a neighbour u costs the sum of squared distances of u to v's
+ * planes, which bounds the geometric error of the result. Vertices on
+ * attribute seams (same position, different normal/color/uv) and on open
+ * borders are never moved, so seams and outlines are preserved exactly.
+ * Kept vertices keep their attributes; nothing is interpolated.
+ */
+class MeshSimplifier
+{
+public:
+    struct Result
+    {
+        size_t triangles = 0;
+        double maxError = 0.0; // largest distance bound of any collapse, in mesh units
+    };
+
+    struct LodSettings
+    {
+        size_t minTriangles = 256;      // meshes smaller than this get no levels
+        unsigned int maxLevels = 4;
+        double reduction = 0.5;         // target triangle ratio from level to level
+        double maxRelativeError = 0.02; // error bound, relative to the bounds diagonal
+        double pixelError = 0.5;        // switch when the error projects below this many pixels
+    };
+
+    struct Level
+    {
+        MeshBuffer mesh;
+        double error = 0.0;
+        double switchSize = 0.0;        // projected diameter in pixels, see RenderObject::addLod
+    };
+
+    // Simplify an indexed mesh to at most targetTriangles, stopping early at
+    // maxError. A non-indexed input is welded first.
+    static Result simplify(const MeshBuffer& input, MeshBuffer& output, size_t targetTriangles, double maxError);
+
+    // Chain of progressively coarser levels of one mesh, each simplified from
+    // the previous one. Stops when a level no longer removes 10% of triangles.
+    static std::vector<Level> generateLods(const MeshBuffer& mesh, const LodSettings& settings);
+
+    // Generate levels for all objects in parallel on the global ThreadPool and
+    // attach them with addLod() (objects that already have levels are skipped).
+    // Returns the number of levels added.
+    static size_t generateLods(const std::vector<RenderObject*>& objects, const LodSettings& settings);
+};
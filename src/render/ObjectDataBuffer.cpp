@@ -0,0 +1,90 @@
+#include "ObjectDataBuffer.h"
+#include "RenderQueue.h"
+#include <algorithm>
+
+
+ObjectDataBuffer::~ObjectDataBuffer()
+{
+    release();
+}
+
+void ObjectDataBuffer::pack(const DrawItem& item, float* texels)
+{
+    const VertexLayout& layout = *item.layout;
+    const float* world = &item.world[0][0];
+    for (int i = 0; i < 16; ++i)
+    {
+        texels[i] = world[i];
+    }
+
+    texels[16] = layout.posScale[0];
+    texels[17] = layout.posScale[1];
+    texels[18] = layout.posScale[2];
+    texels[19] = layout.normalScale;
+
+    texels[20] = layout.posOffset[0];
+    texels[21] = layout.posOffset[1];
+    texels[22] = layout.posOffset[2];
+    texels[23] = layout.octNormals ? 1.0f : 0.0f;
+
+    texels[24] = item.color[0];
+    texels[25] = item.color[1];
+    texels[26] = item.color[2];
+    texels[27] = (float)item.objectID; // exact below 2^24, the selection color range
+
+    texels[28] = layout.hasColors ? 1.0f : 0.0f;
+    texels[29] = 0.0f;
+    texels[30] = 0.0f;
+    texels[31] = 0.0f;
+}
+
+unsigned int ObjectDataBuffer::add(const DrawItem& item)
+{
+    unsigned int index = (unsigned int)size();
+    m_data.resize(m_data.size() + TEXELS * 4);
+    pack(item, &m_data[index * TEXELS * 4]);
+    return index;
+}
+
+void ObjectDataBuffer::upload()
+{
+    if (m_data.empty())
+        return;
+
+    size_t bytes = m_data.size() * sizeof(float);
+    if (bytes > m_capacity)
+    {
+        // Grow with headroom
+        m_capacity = std::max(bytes, m_capacity * 2);
+    }
+
+    if (m_buffer == 0)
+    {
+        glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+
+    // Orphan the storage still read by the previous frame, then one write
+    glBufferData(GL_TEXTURE_BUFFER, m_capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, m_data.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ObjectDataBuffer::bind(GLuint unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+}
+
+void ObjectDataBuffer::release()
+{
+    if (m_texture) { glDeleteTextures(1, &m_texture); m_texture = 0; }
+    if (m_buffer) { glDeleteBuffers(1, &m_buffer); m_buffer = 0; }
+    m_capacity = 0;
+    m_data.clear();
+}
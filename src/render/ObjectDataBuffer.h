@@ -0,0 +1,56 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <vector>
+#include <cstddef>
+
+struct DrawItem;
+
+/**
+ * ObjectDataBuffer holds the per-object data of many draws in one buffer
+ * texture, so a draw only needs the index of its object instead of a set
+ * of uniforms.
+ *
+ * Every object takes TEXELS RGBA32F texels:
+ *   0..3  world matrix columns
+ *   4     posScale.xyz, normalScale
+ *   5     posOffset.xyz, octNormals (0 or 1)
+ *   6     color.rgb, object ID
+ *   7     hasColors (0 or 1), unused
+ * Read by the object data shader (Shader::GetObjectDataShader), which gets
+ * the index from the uint attribute 3: a per-instance array on the
+ * multi-draw indirect path, a constant (glVertexAttribI1ui) otherwise.
+ */
+class ObjectDataBuffer
+{
+public:
+    static const size_t TEXELS = 8;
+
+    ObjectDataBuffer() {}
+    ~ObjectDataBuffer();
+
+    // Write the data of a layout-based draw item into TEXELS * 4 floats
+    static void pack(const DrawItem& item, float* texels);
+
+    void clear() { m_data.clear(); }
+
+    // Append an object, returns its index
+    unsigned int add(const DrawItem& item);
+
+    size_t size() const { return m_data.size() / (TEXELS * 4); }
+
+    // Copy all objects to the GPU with one buffer write; the storage is
+    // only reallocated when it has to grow
+    void upload();
+
+    // Bind the buffer texture to the given texture unit
+    void bind(GLuint unit) const;
+
+    void release();
+
+private:
+    std::vector<float> m_data;
+    size_t m_capacity = 0; // bytes of buffer storage
+    GLuint m_buffer = 0;
+    GLuint m_texture = 0;
+};
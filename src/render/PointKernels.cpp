@@ -0,0 +1,475 @@
+#include "PointKernels.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define POINT_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define POINT_KERNELS_X86 0
+#endif
+
+// GCC and clang need the instruction set enabled per function; MSVC accepts the intrinsics as is
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+
+static const float MIN_NORMAL_LENGTH = 1e-12f;
+
+// ---------------------------------------------------------------------------
+// Scalar reference implementations
+// ---------------------------------------------------------------------------
+
+static void minMaxScalar(const float* p, size_t begin, size_t count, float min[3], float max[3])
+{
+    for (size_t i = begin; i < count; ++i)
+    {
+        const float* v = p + i * 3;
+        if (v[0] < min[0]) min[0] = v[0];
+        if (v[1] < min[1]) min[1] = v[1];
+        if (v[2] < min[2]) min[2] = v[2];
+
+        if (v[0] > max[0]) max[0] = v[0];
+        if (v[1] > max[1]) max[1] = v[1];
+        if (v[2] > max[2]) max[2] = v[2];
+    }
+}
+
+static void faceNormalsScalar(const float* p, const unsigned int* indices, size_t begin, size_t triangleCount, float* out)
+{
+    for (size_t t = begin; t < triangleCount; ++t)
+    {
+        size_t i0 = indices ? indices[t * 3 + 0] : t * 3 + 0;
+        size_t i1 = indices ? indices[t * 3 + 1] : t * 3 + 1;
+        size_t i2 = indices ? indices[t * 3 + 2] : t * 3 + 2;
+        const float* v0 = p + i0 * 3;
+        const float* v1 = p + i1 * 3;
+        const float* v2 = p + i2 * 3;
+
+        float ux = v1[0] - v0[0];
+        float uy = v1[1] - v0[1];
+        float uz = v1[2] - v0[2];
+
+        float vx = v2[0] - v0[0];
+        float vy = v2[1] - v0[1];
+        float vz = v2[2] - v0[2];
+
+        out[t * 3 + 0] = uy * vz - uz * vy;
+        out[t * 3 + 1] = uz * vx - ux * vz;
+        out[t * 3 + 2] = ux * vy - uy * vx;
+    }
+}
+
+static void normalizeScalar(float* p, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+    {
+        float* v = p + i * 3;
+        float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (len > MIN_NORMAL_LENGTH)
+        {
+            v[0] = v[0] / len;
+            v[1] = v[1] / len;
+            v[2] = v[2] / len;
+        }
+        else
+        {
+            v[0] = 0.0f;
+            v[1] = 0.0f;
+            v[2] = 1.0f;
+        }
+    }
+}
+
+static void convertScalar(const double* in, float* out, size_t begin, size_t count)
+{
+    for (size_t i = begin; i < count; ++i)
+    {
+        out[i] = (float)in[i];
+    }
+}
+
+#if POINT_KERNELS_X86
+
+// Fold per-lane minima/maxima of whole xyz blocks back into three components.
+// Lane j of the block holds component j % 3.
+static void reduceLanes(const float* lo, const float* hi, size_t lanes, float min[3], float max[3])
+{
+    for (size_t j = 0; j < lanes; ++j)
+    {
+        size_t k = j % 3;
+        if (lo[j] < min[k]) min[k] = lo[j];
+        if (hi[j] > max[k]) max[k] = hi[j];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SSE2: 4 points (12 floats, three registers) per iteration
+// ---------------------------------------------------------------------------
+
+TARGET_SSE2 static void minMaxSSE2(const float* p, size_t count, float min[3], float max[3])
+{
+    size_t i = 0;
+    if (count >= 4)
+    {
+        __m128 lo0 = _mm_loadu_ps(p), lo1 = _mm_loadu_ps(p + 4), lo2 = _mm_loadu_ps(p + 8);
+        __m128 hi0 = lo0, hi1 = lo1, hi2 = lo2;
+        for (i = 4; i + 4 <= count; i += 4)
+        {
+            const float* q = p + i * 3;
+            __m128 a = _mm_loadu_ps(q), b = _mm_loadu_ps(q + 4), c = _mm_loadu_ps(q + 8);
+            lo0 = _mm_min_ps(lo0, a); lo1 = _mm_min_ps(lo1, b); lo2 = _mm_min_ps(lo2, c);
+            hi0 = _mm_max_ps(hi0, a); hi1 = _mm_max_ps(hi1, b); hi2 = _mm_max_ps(hi2, c);
+        }
+
+        float lo[12], hi[12];
+        _mm_storeu_ps(lo, lo0); _mm_storeu_ps(lo + 4, lo1); _mm_storeu_ps(lo + 8, lo2);
+        _mm_storeu_ps(hi, hi0); _mm_storeu_ps(hi + 4, hi1); _mm_storeu_ps(hi + 8, hi2);
+        reduceLanes(lo, hi, 12, min, max);
+    }
+    minMaxScalar(p, i, count, min, max);
+}
+
+TARGET_SSE2 static void crossSSE2(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz,
+    __m128 cx, __m128 cy, __m128 cz, float* out)
+{
+    __m128 ux = _mm_sub_ps(bx, ax), uy = _mm_sub_ps(by, ay), uz = _mm_sub_ps(bz, az);
+    __m128 vx = _mm_sub_ps(cx, ax), vy = _mm_sub_ps(cy, ay), vz = _mm_sub_ps(cz, az);
+
+    float nx[4], ny[4], nz[4];
+    _mm_storeu_ps(nx, _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy)));
+    _mm_storeu_ps(ny, _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz)));
+    _mm_storeu_ps(nz, _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx)));
+    for (int k = 0; k < 4; ++k)
+    {
+        out[k * 3 + 0] = nx[k];
+        out[k * 3 + 1] = ny[k];
+        out[k * 3 + 2] = nz[k];
+    }
+}
+
+TARGET_SSE2 static void faceNormalsSSE2(const float* p, const unsigned int* indices, size_t triangleCount, float* out)
+{
+    size_t t = 0;
+    for (; t + 4 <= triangleCount; t += 4)
+    {
+        // gather the corners of 4 triangles into structure-of-arrays registers
+        float corner[3][3][4];
+        for (int k = 0; k < 4; ++k)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                size_t index = indices ? indices[(t + k) * 3 + c] : (t + k) * 3 + c;
+                const float* v = p + index * 3;
+                corner[c][0][k] = v[0];
+                corner[c][1][k] = v[1];
+                corner[c][2][k] = v[2];
+            }
+        }
+
+        crossSSE2(
+            _mm_loadu_ps(corner[0][0]), _mm_loadu_ps(corner[0][1]), _mm_loadu_ps(corner[0][2]),
+            _mm_loadu_ps(corner[1][0]), _mm_loadu_ps(corner[1][1]), _mm_loadu_ps(corner[1][2]),
+            _mm_loadu_ps(corner[2][0]), _mm_loadu_ps(corner[2][1]), _mm_loadu_ps(corner[2][2]),
+            out + t * 3);
+    }
+    faceNormalsScalar(p, indices, t, triangleCount, out);
+}
+
+TARGET_SSE2 static void normalizeSSE2(float* p, size_t count)
+{
+    const __m128 minLength = _mm_set1_ps(MIN_NORMAL_LENGTH);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float* q = p + i * 3;
+        __m128 x = _mm_setr_ps(q[0], q[3], q[6], q[9]);
+        __m128 y = _mm_setr_ps(q[1], q[4], q[7], q[10]);
+        __m128 z = _mm_setr_ps(q[2], q[5], q[8], q[11]);
+
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        __m128 valid = _mm_cmpgt_ps(len, minLength);
+
+        x = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(x, len)), _mm_andnot_ps(valid, zero));
+        y = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(y, len)), _mm_andnot_ps(valid, zero));
+        z = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(z, len)), _mm_andnot_ps(valid, one));
+
+        float nx[4], ny[4], nz[4];
+        _mm_storeu_ps(nx, x); _mm_storeu_ps(ny, y); _mm_storeu_ps(nz, z);
+        for (int k = 0; k < 4; ++k)
+        {
+            q[k * 3 + 0] = nx[k];
+            q[k * 3 + 1] = ny[k];
+            q[k * 3 + 2] = nz[k];
+        }
+    }
+    normalizeScalar(p, i, count);
+}
+
+TARGET_SSE2 static void convertSSE2(const double* in, float* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+        _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+    }
+    convertScalar(in, out, i, count);
+}
+
+// ---------------------------------------------------------------------------
+// AVX2: 8 points (24 floats) per iteration, hardware gathers for strided loads
+// ---------------------------------------------------------------------------
+
+TARGET_AVX2 static void minMaxAVX2(const float* p, size_t count, float min[3], float max[3])
+{
+    size_t i = 0;
+    if (count >= 8)
+    {
+        __m256 lo0 = _mm256_loadu_ps(p), lo1 = _mm256_loadu_ps(p + 8), lo2 = _mm256_loadu_ps(p + 16);
+        __m256 hi0 = lo0, hi1 = lo1, hi2 = lo2;
+        for (i = 8; i + 8 <= count; i += 8)
+        {
+            const float* q = p + i * 3;
+            __m256 a = _mm256_loadu_ps(q), b = _mm256_loadu_ps(q + 8), c = _mm256_loadu_ps(q + 16);
+            lo0 = _mm256_min_ps(lo0, a); lo1 = _mm256_min_ps(lo1, b); lo2 = _mm256_min_ps(lo2, c);
+            hi0 = _mm256_max_ps(hi0, a); hi1 = _mm256_max_ps(hi1, b); hi2 = _mm256_max_ps(hi2, c);
+        }
+
+        float lo[24], hi[24];
+        _mm256_storeu_ps(lo, lo0); _mm256_storeu_ps(lo + 8, lo1); _mm256_storeu_ps(lo + 16, lo2);
+        _mm256_storeu_ps(hi, hi0); _mm256_storeu_ps(hi + 8, hi1); _mm256_storeu_ps(hi + 16, hi2);
+        reduceLanes(lo, hi, 24, min, max);
+    }
+    minMaxScalar(p, i, count, min, max);
+}
+
+TARGET_AVX2 static void faceNormalsAVX2(const float* p, const unsigned int* indices, size_t triangleCount, float* out)
+{
+    const __m256i stride3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m256i three = _mm256_set1_epi32(3);
+
+    size_t t = 0;
+    for (; t + 8 <= triangleCount; t += 8)
+    {
+        __m256i corner[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            __m256i vertex;
+            if (indices)
+            {
+                vertex = _mm256_i32gather_epi32(reinterpret_cast<const int*>(indices + t * 3 + c), stride3, 4);
+            }
+            else
+            {
+                vertex = _mm256_add_epi32(_mm256_set1_epi32((int)(t * 3 + c)), stride3);
+            }
+            corner[c] = _mm256_mullo_epi32(vertex, three); // float offset of the vertex
+        }
+
+        __m256 ax = _mm256_i32gather_ps(p + 0, corner[0], 4), ay = _mm256_i32gather_ps(p + 1, corner[0], 4), az = _mm256_i32gather_ps(p + 2, corner[0], 4);
+        __m256 bx = _mm256_i32gather_ps(p + 0, corner[1], 4), by = _mm256_i32gather_ps(p + 1, corner[1], 4), bz = _mm256_i32gather_ps(p + 2, corner[1], 4);
+        __m256 cx = _mm256_i32gather_ps(p + 0, corner[2], 4), cy = _mm256_i32gather_ps(p + 1, corner[2], 4), cz = _mm256_i32gather_ps(p + 2, corner[2], 4);
+
+        __m256 ux = _mm256_sub_ps(bx, ax), uy = _mm256_sub_ps(by, ay), uz = _mm256_sub_ps(bz, az);
+        __m256 vx = _mm256_sub_ps(cx, ax), vy = _mm256_sub_ps(cy, ay), vz = _mm256_sub_ps(cz, az);
+
+        float nx[8], ny[8], nz[8];
+        _mm256_storeu_ps(nx, _mm256_sub_ps(_mm256_mul_ps(uy, vz), _mm256_mul_ps(uz, vy)));
+        _mm256_storeu_ps(ny, _mm256_sub_ps(_mm256_mul_ps(uz, vx), _mm256_mul_ps(ux, vz)));
+        _mm256_storeu_ps(nz, _mm256_sub_ps(_mm256_mul_ps(ux, vy), _mm256_mul_ps(uy, vx)));
+        float* o = out + t * 3;
+        for (int k = 0; k < 8; ++k)
+        {
+            o[k * 3 + 0] = nx[k];
+            o[k * 3 + 1] = ny[k];
+            o[k * 3 + 2] = nz[k];
+        }
+    }
+    faceNormalsScalar(p, indices, t, triangleCount, out);
+}
+
+TARGET_AVX2 static void normalizeAVX2(float* p, size_t count)
+{
+    const __m256i stride3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m256 minLength = _mm256_set1_ps(MIN_NORMAL_LENGTH);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        float* q = p + i * 3;
+        __m256 x = _mm256_i32gather_ps(q + 0, stride3, 4);
+        __m256 y = _mm256_i32gather_ps(q + 1, stride3, 4);
+        __m256 z = _mm256_i32gather_ps(q + 2, stride3, 4);
+
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+        __m256 valid = _mm256_cmp_ps(len, minLength, _CMP_GT_OQ);
+
+        x = _mm256_blendv_ps(zero, _mm256_div_ps(x, len), valid);
+        y = _mm256_blendv_ps(zero, _mm256_div_ps(y, len), valid);
+        z = _mm256_blendv_ps(one, _mm256_div_ps(z, len), valid);
+
+        float nx[8], ny[8], nz[8];
+        _mm256_storeu_ps(nx, x); _mm256_storeu_ps(ny, y); _mm256_storeu_ps(nz, z);
+        for (int k = 0; k < 8; ++k)
+        {
+            q[k * 3 + 0] = nx[k];
+            q[k * 3 + 1] = ny[k];
+            q[k * 3 + 2] = nz[k];
+        }
+    }
+    normalizeScalar(p, i, count);
+}
+
+TARGET_AVX2 static void convertAVX2(const double* in, float* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4));
+        _mm256_storeu_ps(out + i, _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+    }
+    convertScalar(in, out, i, count);
+}
+
+#endif // POINT_KERNELS_X86
+
+// ---------------------------------------------------------------------------
+// Dispatch
+// ---------------------------------------------------------------------------
+
+static PointKernels::SimdLevel& currentLevel()
+{
+    static PointKernels::SimdLevel level = PointKernels::detectLevel();
+    return level;
+}
+
+PointKernels::SimdLevel PointKernels::detectLevel()
+{
+#if POINT_KERNELS_X86
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse2 = ((info[3] >> 26) & 1) != 0;
+    bool osxsave = ((info[2] >> 27) & 1) != 0;
+    bool avx = ((info[2] >> 28) & 1) != 0;
+
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx)
+    {
+        // the OS must save the YMM registers as well
+        bool ymmEnabled = (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        avx2 = ymmEnabled && ((info[1] >> 5) & 1) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse2 = __builtin_cpu_supports("sse2") != 0;
+    bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+    if (avx2) return SIMD_AVX2;
+    if (sse2) return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+PointKernels::SimdLevel PointKernels::getLevel()
+{
+    return currentLevel();
+}
+
+void PointKernels::setLevel(SimdLevel level)
+{
+    // never go above what the CPU supports
+    SimdLevel supported = detectLevel();
+    currentLevel() = level > supported ? supported : level;
+}
+
+const char* PointKernels::levelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_SSE2: return "SSE2";
+    case SIMD_SCALAR:
+    default: return "scalar";
+    }
+}
+
+bool PointKernels::minMax(const float* xyz, size_t count, float min[3], float max[3])
+{
+    if (count == 0)
+        return false;
+
+    min[0] = max[0] = xyz[0];
+    min[1] = max[1] = xyz[1];
+    min[2] = max[2] = xyz[2];
+
+#if POINT_KERNELS_X86
+    switch (getLevel())
+    {
+    case SIMD_AVX2: minMaxAVX2(xyz, count, min, max); return true;
+    case SIMD_SSE2: minMaxSSE2(xyz, count, min, max); return true;
+    default: break;
+    }
+#endif
+    minMaxScalar(xyz, 1, count, min, max);
+    return true;
+}
+
+void PointKernels::faceNormals(const float* positions, const unsigned int* indices, size_t triangleCount, float* out)
+{
+#if POINT_KERNELS_X86
+    switch (getLevel())
+    {
+    case SIMD_AVX2: faceNormalsAVX2(positions, indices, triangleCount, out); return;
+    case SIMD_SSE2: faceNormalsSSE2(positions, indices, triangleCount, out); return;
+    default: break;
+    }
+#endif
+    faceNormalsScalar(positions, indices, 0, triangleCount, out);
+}
+
+void PointKernels::normalize(float* xyz, size_t count)
+{
+#if POINT_KERNELS_X86
+    switch (getLevel())
+    {
+    case SIMD_AVX2: normalizeAVX2(xyz, count); return;
+    case SIMD_SSE2: normalizeSSE2(xyz, count); return;
+    default: break;
+    }
+#endif
+    normalizeScalar(xyz, 0, count);
+}
+
+void PointKernels::convert(const double* in, float* out, size_t count)
+{
+#if POINT_KERNELS_X86
+    switch (getLevel())
+    {
+    case SIMD_AVX2: convertAVX2(in, out, count); return;
+    case SIMD_SSE2: convertSSE2(in, out, count); return;
+    default: break;
+    }
+#endif
+    convertScalar(in, out, 0, count);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * PointKernels are batch versions of the Point3D math used on hot paths.
+ *
+ * Every kernel works on packed float triples (x, y, z, x, y, z, ...) as stored
+ * by MeshBuffer. Each has a scalar, an SSE2 and an AVX2 implementation; the
+ * best one supported by the CPU is picked at first use. The vector versions
+ * perform the same IEEE operations in the same order as the scalar code, so
+ * all levels give bitwise identical results for finite input as long as the
+ * compiler does not contract the scalar code into FMA (CMakeLists.txt builds
+ * this file with -ffp-contract=off).
+ */
+class PointKernels
+{
+public:
+    enum SimdLevel
+    {
+        SIMD_SCALAR,
+        SIMD_SSE2,
+        SIMD_AVX2
+    };
+
+    // Highest level supported by this CPU and build
+    static SimdLevel detectLevel();
+
+    // Level currently used by the kernels; can be lowered for comparisons
+    static SimdLevel getLevel();
+    static void setLevel(SimdLevel level);
+    static const char* levelName(SimdLevel level);
+
+    // Component-wise min/max over count points; returns false when count == 0
+    static bool minMax(const float* xyz, size_t count, float min[3], float max[3]);
+
+    // Unnormalized face normal (v1 - v0) x (v2 - v0) of every triangle.
+    // With indices == nullptr the positions are read as a plain triangle list.
+    static void faceNormals(const float* positions, const unsigned int* indices, size_t triangleCount, float* out);
+
+    // Normalize every vector in place; vectors shorter than 1e-12 become (0, 0, 1)
+    static void normalize(float* xyz, size_t count);
+
+    // Narrow count doubles to floats
+    static void convert(const double* in, float* out, size_t count);
+};
@@ -2,430 +2,912 @@
 #include "SceneGraph.h"
 #include <GL/glew.h>
 #include <GL/gl.h>
+#include "PointKernels.h"
+#include "MeshOptimizer.h"
+#include "GeometryCache.h"
+#include "VertexArena.h"
+#include "SelectionBuffer.h"
 #include "../gl/Shader.h"
 #include <cmath>
+#include <cstdio>
+#include <chrono>
 
 
-static void multiply4(const GLfloat a[16], const GLfloat b[16], GLfloat out[16])
-{
-    // out = a * b (column-major)
-    for (int row = 0; row < 4; ++row) {
-        for (int col = 0; col < 4; ++col) {
-            float sum = 0.0f;
-            for (int k = 0; k < 4; ++k) {
-                sum += a[k * 4 + row] * b[col * 4 + k];
-            }
-            out[col * 4 + row] = sum;
-        }
-    }
-}
 
+bool RenderObject::s_logResources = true;
 
 RenderObject::RenderObject(const std::string& name)
     : m_name(name)
+    , m_vertexFormat(VERTEX_FORMAT)
 {
     // Constructor implementation (if needed)
 }
 
 RenderObject::~RenderObject()
 {
+    // Children may outlive this node through other shared_ptr owners
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child && child->m_parent == this)
+        {
+            child->m_parent = nullptr;
+        }
+    }
+
     // Cleanup any GL resources
     cleanRenderResources();
 }
 
+void RenderObject::addChild(const std::shared_ptr<RenderObject> child)
+{
+    m_children.push_back(child);
+    if (child)
+    {
+        child->m_parent = this;
+        child->invalidateTransform();
+    }
+    invalidateBounds();
+}
+
+void RenderObject::removeChild(const size_t i)
+{
+    if (i < m_children.size())
+    {
+        if (m_children[i] && m_children[i]->m_parent == this)
+        {
+            m_children[i]->m_parent = nullptr;
+            m_children[i]->invalidateTransform();
+        }
+        m_children.erase(m_children.begin() + i);
+        invalidateBounds();
+    }
+}
+
+void RenderObject::invalidateBounds()
+{
+    // This node may already be flagged by invalidateTransform(); ancestors are
+    // walked until the first one that is already dirty, whose own ancestors are dirty too
+    m_boundsDirty = true;
+    RenderObject* node = m_parent;
+    while (node && !node->m_boundsDirty)
+    {
+        node->m_boundsDirty = true;
+        node = node->m_parent;
+    }
+
+    markChanged();
+}
+
+void RenderObject::markChanged()
+{
+    for (RenderObject* node = this; node; node = node->m_parent)
+    {
+        ++node->m_revision;
+    }
+}
+
+void RenderObject::invalidateTransform()
+{
+    // A clean node always has clean ancestors, so an already dirty node
+    // means its whole subtree is dirty too
+    if (m_worldDirty)
+        return;
+
+    m_worldDirty = true;
+    m_boundsDirty = true;
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child)
+        {
+            child->invalidateTransform();
+        }
+    }
+}
+
 void RenderObject::setPosition(const PointDouble3D& position)
 {
     m_position = position;
-    for (PointDouble3D& v : m_vertices)
+    m_localTransform[3] = glm::vec4((float)position.x, (float)position.y, (float)position.z, 1.0f);
+
+    invalidateTransform();
+    invalidateBounds();
+}
+
+void RenderObject::setLocalTransform(const glm::mat4& transform)
+{
+    m_localTransform = transform;
+    m_position = PointDouble3D(transform[3].x, transform[3].y, transform[3].z);
+
+    invalidateTransform();
+    invalidateBounds();
+}
+
+const glm::mat4& RenderObject::getWorldTransform() const
+{
+    if (m_worldDirty)
     {
-        v = (v + position);
+        if (m_parent)
+        {
+            m_worldTransform = m_parent->getWorldTransform() * m_localTransform;
+        }
+        else
+        {
+            m_worldTransform = m_localTransform;
+        }
+        m_worldDirty = false;
     }
+    return m_worldTransform;
 }
 
-bool RenderObject::getVolume(PointDouble3D& min, PointDouble3D& max) const
+// Bounds of an object space box after an affine transform (Arvo's method)
+static void transformBounds(const glm::mat4& m, PointDouble3D& min, PointDouble3D& max)
 {
-    // If we have no local vertices, try to derive volume from children
-    if (m_vertices.empty())
+    double center[3] = { 0.5 * (min.x + max.x), 0.5 * (min.y + max.y), 0.5 * (min.z + max.z) };
+    double extent[3] = { 0.5 * (max.x - min.x), 0.5 * (max.y - min.y), 0.5 * (max.z - min.z) };
+
+    double outCenter[3];
+    double outExtent[3];
+    for (int row = 0; row < 3; ++row)
     {
-        bool found = false;
-        for (const auto& child : m_children)
+        outCenter[row] = m[3][row];
+        outExtent[row] = 0.0;
+        for (int col = 0; col < 3; ++col)
         {
-            if (!child) continue;
-            PointDouble3D childMin, childMax;
-            if (child->getVolume(childMin, childMax))
-            {
-                if (!found)
-                {
-                    min = childMin;
-                    max = childMax;
-                    found = true;
-                }
-                else
-                {
-                    if (childMin.x < min.x) min.x = childMin.x;
-                    if (childMin.y < min.y) min.y = childMin.y;
-                    if (childMin.z < min.z) min.z = childMin.z;
-
-                    if (childMax.x > max.x) max.x = childMax.x;
-                    if (childMax.y > max.y) max.y = childMax.y;
-                    if (childMax.z > max.z) max.z = childMax.z;
-                }
-            }
+            outCenter[row] += m[col][row] * center[col];
+            outExtent[row] += std::fabs(m[col][row]) * extent[col];
         }
-        return found;
     }
 
-    // Initialize min and max with the first local vertex
-    min = m_vertices[0];
-    max = m_vertices[0];
-    for (size_t i = 1; i < m_vertices.size(); ++i)
+    min = PointDouble3D(outCenter[0] - outExtent[0], outCenter[1] - outExtent[1], outCenter[2] - outExtent[2]);
+    max = PointDouble3D(outCenter[0] + outExtent[0], outCenter[1] + outExtent[1], outCenter[2] + outExtent[2]);
+}
+
+bool RenderObject::computeLocalVolume(PointDouble3D& min, PointDouble3D& max) const
+{
+    return m_mesh.getBounds(min, max);
+}
+
+bool RenderObject::getVolume(PointDouble3D& min, PointDouble3D& max) const
+{
+    if (!m_boundsDirty)
     {
-        const auto& v = m_vertices[i];
-        if (v.x < min.x) min.x = v.x;
-        if (v.y < min.y) min.y = v.y;
-        if (v.z < min.z) min.z = v.z;
+        min = m_boundsMin;
+        max = m_boundsMax;
+        return m_hasBounds;
+    }
 
-        if (v.x > max.x) max.x = v.x;
-        if (v.y > max.y) max.y = v.y;
-        if (v.z > max.z) max.z = v.z;
+    // Local geometry first; if there is none, derive the volume from children only
+    bool found = computeLocalVolume(min, max);
+    if (found)
+    {
+        transformBounds(getWorldTransform(), min, max);
     }
 
-    // Expand by children's volumes
     for (const auto& child : m_children)
     {
         if (!child) continue;
         PointDouble3D childMin, childMax;
         if (child->getVolume(childMin, childMax))
         {
-            if (childMin.x < min.x) min.x = childMin.x;
-            if (childMin.y < min.y) min.y = childMin.y;
-            if (childMin.z < min.z) min.z = childMin.z;
+            if (!found)
+            {
+                min = childMin;
+                max = childMax;
+                found = true;
+            }
+            else
+            {
+                if (childMin.x < min.x) min.x = childMin.x;
+                if (childMin.y < min.y) min.y = childMin.y;
+                if (childMin.z < min.z) min.z = childMin.z;
 
-            if (childMax.x > max.x) max.x = childMax.x;
-            if (childMax.y > max.y) max.y = childMax.y;
-            if (childMax.z > max.z) max.z = childMax.z;
+                if (childMax.x > max.x) max.x = childMax.x;
+                if (childMax.y > max.y) max.y = childMax.y;
+                if (childMax.z > max.z) max.z = childMax.z;
+            }
         }
     }
 
-    return true;
+    m_boundsMin = min;
+    m_boundsMax = max;
+    m_hasBounds = found;
+    m_boundsDirty = false;
+    return found;
 }
 
 void RenderObject::buildGraphicsResources()
 {
-    bool hasNormals = (m_normals.size() == m_vertices.size());
-    bool hasPerVertexColors = (m_colors.size() == m_vertices.size());
+    auto start = std::chrono::steady_clock::now();
+
+    // Optional attributes that do not match the vertex count are ignored;
+    // a missing color array falls back to the constant m_color
+    m_mesh.dropMismatchedAttributes();
+
+    // Identical geometry shares one set of buffers; on a hit the mesh is
+    // neither processed nor uploaded again. The key is taken from the mesh
+    // as given, before welding and normal generation, and kept, so later
+    // builds find the same entry.
+    takeGeometryKeys();
+    bool buffered = (getRenderMethod() == RENDER_VAO || getRenderMethod() == RENDER_VBO);
+    // fixed-function arrays cannot decode the compact formats
+    VertexFormat format = (getRenderMethod() == RENDER_VAO) ? m_vertexFormat : VERTEX_FORMAT_FLOAT;
+    uint64_t geometryKey = 0;
+    bool cached = false;
+    if (buffered && !m_geometry && !m_mesh.empty())
+    {
+        geometryKey = GeometryCache::combine(m_geometryKey, (uint64_t)format * 2 + (useArena() ? 1 : 0));
+        m_geometry = GeometryCache::global().find(geometryKey);
+        cached = (m_geometry != nullptr);
+    }
 
-    if (!hasNormals)
+    // Processed once; later builds (after a release, for another render
+    // method) upload the prepared mesh as it is
+    size_t soupVertices = m_mesh.vertexCount();
+    if (!m_geometry && !m_meshPrepared && m_dispList == 0)
+    {
+        prepareMesh();
+    }
+    else if (!cached && !m_mesh.hasNormals())
     {
         createDefaultNormal();
     }
 
-    if (!hasPerVertexColors)
+    // A hit leaves the CPU mesh as it was given, normals or not
+    if (!m_mesh.empty() && (cached || m_mesh.hasNormals()))
     {
-        m_colors.assign(m_vertices.size(), m_color);
+        if (buffered)
+        {
+            if (!m_geometry)
+            {
+                m_geometry = GeometryCache::global().insert(geometryKey, uploadGeometry(m_mesh, format, useArena()));
+            }
+
+            m_vbo = m_geometry->vbo;
+            m_ibo = m_geometry->ibo;
+            m_layout = m_geometry->layout;
+            m_indexType = m_geometry->indexType;
+            m_drawCount = m_geometry->drawCount;
+            m_vboCount = m_geometry->vertexCount;
+
+            if (getRenderMethod() == RENDER_VAO)
+            {
+                if (m_geometry->arena)
+                {
+                    // Shared by every range of the arena, not owned
+                    m_vao = m_geometry->arena->getVao();
+                }
+                else if (m_vao == 0)
+                {
+                    m_vao = createVAO(m_vbo, m_ibo, m_layout);
+                }
+
+                buildLodResources();
+            }
+        }
+        else
+        {
+            m_vboCount = m_mesh.vertexCount();
+            m_drawCount = (GLsizei)m_mesh.elementCount();
+
+            // Client arrays draw straight from m_mesh, nothing to create
+            if (getRenderMethod() == RENDER_IMMEDIATE && m_dispList == 0)
+            {
+                m_dispList = createDispList(m_mesh);
+            }
+        }
+
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (s_logResources)
+        {
+            printf("RenderObject::buildGraphicsResources(%s): %u vertices (%u before welding), %u indices, %u bytes/vertex on CPU (%u as PointDouble3D), %u bytes/vertex on GPU (%s%s), %.3f ms\n",
+                m_name.c_str(),
+                (unsigned)m_vboCount,
+                (unsigned)soupVertices,
+                (unsigned)(buffered ? (m_indexType != 0 ? m_drawCount : 0) : m_mesh.indices().size()),
+                (unsigned)m_mesh.bytesPerVertex(),
+                (unsigned)(4 * sizeof(PointDouble3D)),
+                (unsigned)m_layout.stride,
+                vertexFormatName(m_layout.format),
+                cached ? ", shared" : "",
+                elapsedMs);
+        }
     }
 
-    if (m_vertices.empty() || m_normals.size() != m_vertices.size())
-        return;
+    markChanged();
 
-    if (RENDER_METHOD == RENDER_VAO)
+    for (const std::shared_ptr<RenderObject>& child : m_children)
     {
-        if (m_vbo == 0)
+        if (child)
         {
-            m_vbo = createVBO(m_vertices, m_normals, m_colors);
+            child->buildGraphicsResources();
         }
+    }
+}
 
-        if (m_vao == 0)
+bool RenderObject::useArena() const
+{
+    return m_useVertexArena && getRenderMethod() == RENDER_VAO;
+}
+
+uint64_t RenderObject::getGeometryKey() const
+{
+    return GeometryCache::hashMesh(m_mesh);
+}
+
+void RenderObject::cleanRenderResources()
+{
+    // Arena VAOs are shared by every range of the arena
+    bool arenaVao = m_geometry && m_geometry->arena;
+    if (m_vao && !arenaVao) { glDeleteVertexArrays(1, &m_vao); }
+    m_vao = 0;
+    // Buffers are shared through the GeometryCache and deleted with the last user
+    m_geometry.reset();
+    m_vbo = 0;
+    m_ibo = 0;
+    if (m_dispList) { glDeleteLists(m_dispList, 1); m_dispList = 0; }
+
+    for (LodLevel& lod : m_lods)
+    {
+        if (lod.vao && !(lod.geometry && lod.geometry->arena)) { glDeleteVertexArrays(1, &lod.vao); }
+        lod.vao = 0;
+        lod.geometry.reset();
+        lod.vbo = 0;
+        lod.ibo = 0;
+    }
+}
+
+void RenderObject::addLod(const MeshBuffer& mesh, double switchSize)
+{
+    LodLevel lod;
+    lod.mesh = mesh;
+    lod.switchSize = switchSize;
+    m_lods.push_back(lod);
+    m_meshPrepared = false;
+    markChanged();
+}
+
+void RenderObject::prepareGeometry()
+{
+    if (!m_meshPrepared)
+    {
+        // buildGraphicsResources skips this from now on
+        prepareMesh();
+    }
+
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child)
         {
-            m_vao = createVAO(m_vbo);
+            child->prepareGeometry();
         }
     }
-    else if (RENDER_METHOD == RENDER_VBO)
+}
+
+void RenderObject::takeGeometryKeys()
+{
+    if (m_geometryKey == 0)
+    {
+        m_geometryKey = getGeometryKey();
+    }
+
+    for (LodLevel& lod : m_lods)
     {
-        if (m_vbo == 0)
+        if (lod.geometryKey == 0)
         {
-            m_vbo = createVBO(m_vertices, m_normals, m_colors);
+            lod.geometryKey = GeometryCache::hashMesh(lod.mesh);
         }
     }
-    else
+}
+
+void RenderObject::prepareMesh()
+{
+    m_mesh.dropMismatchedAttributes();
+    takeGeometryKeys();
+    weldMesh();
+
+    // Generated after welding, so they are smooth over the shared vertices
+    if (!m_mesh.hasNormals())
+    {
+        createDefaultNormal();
+    }
+
+    // Reorder for the post-transform cache, overdraw and vertex fetch once,
+    // before the first upload
+    if (m_mesh.isIndexed())
     {
-        if (m_dispList == 0)
+        MeshOptimizer::optimize(m_mesh, s_logResources ? m_name.c_str() : nullptr);
+    }
+
+    for (LodLevel& lod : m_lods)
+    {
+        lod.mesh.dropMismatchedAttributes();
+        if (lod.mesh.isIndexed())
         {
-            m_dispList = createDispList(m_vertices, m_normals, m_colors);
+            MeshOptimizer::optimize(lod.mesh);
         }
     }
-    
+
+    m_meshPrepared = true;
+}
+
+void RenderObject::releaseGraphicsResources()
+{
+    cleanRenderResources();
+
     for (const std::shared_ptr<RenderObject>& child : m_children)
     {
         if (child)
         {
-            child->buildGraphicsResources();
+            child->releaseGraphicsResources();
         }
     }
 }
 
-void RenderObject::cleanRenderResources()
+void RenderObject::clearLods()
 {
-    if (m_vao) { glDeleteVertexArrays(1, &m_vao); m_vao = 0; }
-    if (m_vbo) { glDeleteBuffers(1, &m_vbo); m_vbo = 0; }
-    if (m_dispList) { glDeleteLists(m_dispList, 1); m_dispList = 0; }
+    for (LodLevel& lod : m_lods)
+    {
+        if (lod.vao && !(lod.geometry && lod.geometry->arena)) { glDeleteVertexArrays(1, &lod.vao); }
+    }
+    m_lods.clear();
+    m_currentLod = 0;
+    markChanged();
 }
 
-void RenderObject::createDefaultNormal()
+void RenderObject::buildLodResources()
+{
+    for (LodLevel& lod : m_lods)
+    {
+        if (lod.vao != 0)
+            continue;
+
+        lod.mesh.dropMismatchedAttributes();
+        if (lod.mesh.empty() || !lod.mesh.hasNormals())
+            continue;
+
+        uint64_t key = GeometryCache::combine(lod.geometryKey, (uint64_t)m_vertexFormat * 2 + (useArena() ? 1 : 0));
+        lod.geometry = GeometryCache::global().find(key);
+        if (!lod.geometry)
+        {
+            if (!m_meshPrepared)
+                MeshOptimizer::optimize(lod.mesh);
+            lod.geometry = GeometryCache::global().insert(key, uploadGeometry(lod.mesh, m_vertexFormat, useArena()));
+        }
+
+        lod.vbo = lod.geometry->vbo;
+        lod.ibo = lod.geometry->ibo;
+        lod.layout = lod.geometry->layout;
+        lod.indexType = lod.geometry->indexType;
+        lod.drawCount = lod.geometry->drawCount;
+        lod.vao = lod.geometry->arena ? lod.geometry->arena->getVao() : createVAO(lod.vbo, lod.ibo, lod.layout);
+    }
+}
+
+unsigned int RenderObject::selectLod(double screenSize, float bias) const
 {
-    m_normals.clear();
+    static const double HYSTERESIS = 0.15;
 
-    if (m_vertices.size() == 3)
+    double size = screenSize * bias;
+    unsigned int level = 0;
+    for (size_t k = 0; k < m_lods.size(); ++k)
     {
-        m_normals.push_back(PointDouble3D(0.0, 0.0, 1.0));
-        m_normals.push_back(PointDouble3D(0.0, 0.0, 1.0));
-        m_normals.push_back(PointDouble3D(0.0, 0.0, 1.0));
+        // Coarser than level k is kept until clearly above the threshold,
+        // and only entered once clearly below it
+        double threshold = m_lods[k].switchSize * (m_currentLod > k ? 1.0 + HYSTERESIS : 1.0 - HYSTERESIS);
+        if (size >= threshold)
+            break;
+        level = (unsigned int)k + 1;
+    }
+
+    m_currentLod = level;
+    return level;
+}
+
+void RenderObject::applyLod(unsigned int level, DrawItem& item) const
+{
+    if (level == 0 || level > m_lods.size() || m_lods[level - 1].vao == 0)
+    {
+        item.vao = m_vao;
+        item.count = m_drawCount;
+        item.indexType = m_indexType;
+        item.baseVertex = m_geometry ? m_geometry->baseVertex() : 0;
+        item.indexOffset = m_geometry ? m_geometry->indexOffset() : 0;
+        item.layout = &m_layout;
         return;
     }
 
-    // compute face normal for the triangle that contains this vertex
-    for (size_t i = 0; i < m_vertices.size(); ++i)
+    const LodLevel& lod = m_lods[level - 1];
+    item.vao = lod.vao;
+    item.count = lod.drawCount;
+    item.indexType = lod.indexType;
+    item.baseVertex = lod.geometry->baseVertex();
+    item.indexOffset = lod.geometry->indexOffset();
+    item.layout = &lod.layout;
+}
+
+void RenderObject::weldMesh()
+{
+    // Share identical vertices through an index buffer. Triangle soups with
+    // per-face attributes may not weld at all; those stay non-indexed.
+    // Runs before normals are generated: flat normals would make every
+    // corner of a soup unique.
+    takeGeometryKeys();
+    if (!m_mesh.isIndexed() && !m_mesh.empty())
     {
-        size_t triStart = (i / 3) * 3;
-        if (triStart + 2 < m_vertices.size())
+        size_t soupVertices = m_mesh.vertexCount();
+        m_mesh.weld();
+        if (m_mesh.vertexCount() == soupVertices)
         {
-            PointDouble3D v0 = m_vertices[triStart + 0];
-            PointDouble3D v1 = m_vertices[triStart + 1];
-            PointDouble3D v2 = m_vertices[triStart + 2];
+            m_mesh.clearIndices();
+        }
+    }
+}
 
-            double ux = v1.x - v0.x;
-            double uy = v1.y - v0.y;
-            double uz = v1.z - v0.z;
+void RenderObject::createDefaultNormal()
+{
+    size_t count = m_mesh.vertexCount();
+    m_mesh.clearNormals();
 
-            double vx = v2.x - v0.x;
-            double vy = v2.y - v0.y;
-            double vz = v2.z - v0.z;
+    if (count == 3)
+    {
+        m_mesh.addNormal(0.0f, 0.0f, 1.0f);
+        m_mesh.addNormal(0.0f, 0.0f, 1.0f);
+        m_mesh.addNormal(0.0f, 0.0f, 1.0f);
+        return;
+    }
 
-            double nx = uy * vz - uz * vy;
-            double ny = uz * vx - ux * vz;
-            double nz = ux * vy - uy * vx;
+    if (m_mesh.isIndexed())
+    {
+        createSmoothNormal();
+        return;
+    }
 
-            double len = std::sqrt(nx * nx + ny * ny + nz * nz);
-            if (len > 1e-12)
-            {
-                nx /= len; ny /= len; nz /= len;
-            }
-            glNormal3f(static_cast<float>(nx), static_cast<float>(ny), static_cast<float>(nz));
-        }
-        else
-        {
-            // fallback normal
-            glNormal3f(0.0f, 0.0f, 1.0f);
-        }
+    // every vertex of a triangle gets that triangle's face normal
+    size_t triangleCount = count / 3;
+    std::vector<float> faceNormals(triangleCount * 3);
+    PointKernels::faceNormals(m_mesh.positions(), nullptr, triangleCount, faceNormals.data());
+    PointKernels::normalize(faceNormals.data(), triangleCount);
+
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const float* n = &faceNormals[t * 3];
+        m_mesh.addNormal(n[0], n[1], n[2]);
+        m_mesh.addNormal(n[0], n[1], n[2]);
+        m_mesh.addNormal(n[0], n[1], n[2]);
+    }
+
+    // fallback normal for trailing vertices that do not form a full triangle
+    for (size_t i = triangleCount * 3; i < count; ++i)
+    {
+        m_mesh.addNormal(0.0f, 0.0f, 1.0f);
     }
 }
 
-void RenderObject::Render()
+void RenderObject::createSmoothNormal()
 {
-    // glEnable(GL_COLOR_MATERIAL);
-    // glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
-    // glEnable(GL_NORMALIZE);
+    // Shared vertices get the area weighted average of their face normals
+    size_t count = m_mesh.vertexCount();
+    const std::vector<unsigned int>& indices = m_mesh.indices();
+    size_t triangleCount = indices.size() / 3;
 
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glTranslatef((GLfloat)m_position.x, (GLfloat)m_position.y, (GLfloat)m_position.z);
+    std::vector<float> faceNormals(triangleCount * 3);
+    PointKernels::faceNormals(m_mesh.positions(), indices.data(), triangleCount, faceNormals.data());
 
-    // Prefer VBO rendering for speed. Initialize VBOs once when possible.
-    switch (RENDER_METHOD)
+    std::vector<float> accum(count * 3, 0.0f);
+    for (size_t t = 0; t < triangleCount; ++t)
     {
-    case RENDER_VAO:
+        const float* fn = &faceNormals[t * 3];
+        for (int k = 0; k < 3; ++k)
+        {
+            float* n = &accum[indices[t * 3 + k] * 3];
+            n[0] += fn[0]; n[1] += fn[1]; n[2] += fn[2];
+        }
+    }
+    PointKernels::normalize(accum.data(), count);
+
+    m_mesh.clearNormals();
+    for (size_t i = 0; i < count; ++i)
     {
-        printf("RenderObject::Render(%s) with VAO\n", m_name.c_str());
-        RenderWithVAO();
-        break;
+        m_mesh.addNormal(accum[i * 3 + 0], accum[i * 3 + 1], accum[i * 3 + 2]);
     }
-    case RENDER_VBO:
-        printf("RenderObject::Render(%s) with VBO\n", m_name.c_str());
-        RenderWithVBO();
-        break;
-    case RENDER_IMMEDIATE:
+}
+
+bool RenderObject::hasDrawResources() const
+{
+    switch (getRenderMethod())
+    {
+    case RENDER_VAO:
+        return m_vao != 0;
+    case RENDER_CLIENT_ARRAY:
+        return m_drawCount > 0 && !m_mesh.empty() && m_mesh.hasNormals();
     default:
-        printf("RenderObject::Render(%s) with Immediate Mode\n", m_name.c_str());
-        RenderWithImmediate();
-        break;
+        return m_vbo != 0 || m_dispList != 0;
+    }
+}
+
+DrawItem RenderObject::makeDrawItem() const
+{
+    DrawItem item;
+    item.world = getWorldTransform();
+    item.shader = (getRenderMethod() == RENDER_VAO) ? Shader::GetDefaultShader() : nullptr;
+    item.vao = m_vao;
+    item.count = m_drawCount;
+    item.indexType = m_indexType;
+    item.baseVertex = m_geometry ? m_geometry->baseVertex() : 0;
+    item.indexOffset = m_geometry ? m_geometry->indexOffset() : 0;
+    item.objectID = m_objectID;
+    SelectionBuffer::objectIDToColor(m_objectID, item.selectColor);
+    item.color[0] = (float)m_color.x;
+    item.color[1] = (float)m_color.y;
+    item.color[2] = (float)m_color.z;
+
+    PointDouble3D min, max;
+    if (computeLocalVolume(min, max))
+    {
+        item.center = glm::vec3((float)(0.5 * (min.x + max.x)), (float)(0.5 * (min.y + max.y)), (float)(0.5 * (min.z + max.z)));
+        transformBounds(item.world, min, max);
+        item.boundsMin = glm::vec3((float)min.x, (float)min.y, (float)min.z);
+        item.boundsMax = glm::vec3((float)max.x, (float)max.y, (float)max.z);
+    }
+    else
+    {
+        glm::vec4 origin = item.world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        item.boundsMin = item.boundsMax = glm::vec3(origin.x, origin.y, origin.z);
+    }
+
+    item.layout = &m_layout;
+    item.object = this;
+    return item;
+}
+
+void RenderObject::collectDrawItems(std::vector<DrawItem>& items) const
+{
+    if (hasDrawResources())
+    {
+        items.push_back(makeDrawItem());
     }
 
     for (const std::shared_ptr<RenderObject>& child : m_children)
     {
         if (child)
         {
-            child->Render();
+            child->collectDrawItems(items);
         }
     }
-
-    glPopMatrix();
 }
 
-void RenderObject::RenderWithVAO()
+void RenderObject::renderGeometry() const
 {
-    if (m_vao == 0)
-        return;
+    switch (getRenderMethod())
+    {
+    case RENDER_VBO:
+        RenderWithVBO();
+        break;
+    case RENDER_CLIENT_ARRAY:
+        RenderWithClientArray();
+        break;
+    case RENDER_IMMEDIATE:
+        RenderWithImmediate();
+        break;
+    default:
+        break;
+    }
+}
 
-    // Convert object ID to RGB color
-    float selectionColor[3];
-    selectionColor[0] = ((m_objectID >> 16) & 0xFF) / 255.0f; // Red
-    selectionColor[1] = ((m_objectID >> 8) & 0xFF) / 255.0f;  // Green
-    selectionColor[2] = (m_objectID & 0xFF) / 255.0f;         // Blue
-
-    GLfloat proj[16]; GLfloat model[16]; GLfloat mvp[16];
-    glGetFloatv(GL_PROJECTION_MATRIX, proj);
-    glGetFloatv(GL_MODELVIEW_MATRIX, model);
-    multiply4(proj, model, mvp);
-    Shader::GetDefaultShader()->setUniformMat4f("mvp", mvp);
-    Shader::GetDefaultShader()->setUniformMat4f("model", model);
-    Shader::GetDefaultShader()->setUniformVec3f("selectColor", selectionColor);
-
-    glBindVertexArray(m_vao);
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)m_vertices.size());
-    glBindVertexArray(0);
+void RenderObject::drawElements() const
+{
+    GLint baseVertex = m_geometry ? m_geometry->baseVertex() : 0;
+    if (m_indexType != 0)
+    {
+        size_t indexOffset = m_geometry ? m_geometry->indexOffset() : 0;
+        glDrawElementsBaseVertex(GL_TRIANGLES, m_drawCount, m_indexType, reinterpret_cast<void*>(indexOffset), baseVertex);
+    }
+    else
+    {
+        glDrawArrays(GL_TRIANGLES, baseVertex, m_drawCount);
+    }
 }
 
-void RenderObject::RenderWithVBO()
+void RenderObject::RenderWithVBO() const
 {
     if (m_vbo == 0)
         return;
 
     glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    GLsizei stride = 9 * sizeof(float);
+    GLsizei stride = m_layout.stride;
     glEnableClientState(GL_VERTEX_ARRAY);
     glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<void*>(0));
 
     glEnableClientState(GL_NORMAL_ARRAY);
     glNormalPointer(GL_FLOAT, stride, reinterpret_cast<void*>(3 * sizeof(float)));
 
-    glEnableClientState(GL_COLOR_ARRAY);
-    glColorPointer(3, GL_FLOAT, stride, reinterpret_cast<void*>(6 * sizeof(float)));
+    if (m_layout.hasColors)
+    {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(3, GL_FLOAT, stride, reinterpret_cast<void*>(6 * sizeof(float)));
+    }
+    else
+    {
+        glColor3f((GLfloat)m_color.x, (GLfloat)m_color.y, (GLfloat)m_color.z);
+    }
 
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)m_vertices.size());
+    if (m_ibo != 0)
+    {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    }
+    drawElements();
 
     glDisableClientState(GL_COLOR_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
     glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void RenderObject::RenderWithImmediate()
+void RenderObject::RenderWithClientArray() const
 {
-    glCallList(m_dispList);
-}
+    if (m_mesh.empty() || !m_mesh.hasNormals())
+        return;
 
-GLuint RenderObject::createVBO(
-    const std::vector<PointDouble3D>& vertices, 
-    const std::vector<PointDouble3D>& normals, 
-    const std::vector<PointDouble3D>& colors)
-{
-    size_t vertexCount = vertices.size();
+    // Pointers into client memory, copied by the driver on every draw
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    size_t bufferCount = vertexCount * 3 * 3;  //interleaved buffer
-    std::vector<float> buffer;
-    buffer.reserve(bufferCount);
-    for (size_t i = 0; i < vertexCount; ++i)
-    {
-        const auto& v = vertices[i];
-        const auto& n = normals[i];
-        const auto& c = colors[i];
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, m_mesh.positions());
 
-        // Vertex
-        buffer.push_back((float)v.x);
-        buffer.push_back((float)v.y);
-        buffer.push_back((float)v.z);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, 0, m_mesh.normals());
 
-        // Normal
-        buffer.push_back((float)n.x);
-        buffer.push_back((float)n.y);
-        buffer.push_back((float)n.z);
+    if (m_mesh.hasColors())
+    {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(3, GL_FLOAT, 0, m_mesh.colors());
+    }
+    else
+    {
+        glColor3f((GLfloat)m_color.x, (GLfloat)m_color.y, (GLfloat)m_color.z);
+    }
 
-        // Color
-        buffer.push_back((float)c.x);
-        buffer.push_back((float)c.y);
-        buffer.push_back((float)c.z);
+    if (m_mesh.isIndexed())
+    {
+        glDrawElements(GL_TRIANGLES, (GLsizei)m_mesh.indices().size(), GL_UNSIGNED_INT, m_mesh.indices().data());
     }
+    else
+    {
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)m_mesh.vertexCount());
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void RenderObject::RenderWithImmediate() const
+{
+    glCallList(m_dispList);
+}
+
+GLuint RenderObject::createVBO(const MeshBuffer& mesh, VertexFormat format, VertexLayout& layout)
+{
+    std::vector<unsigned char> buffer;
+    layout = encodeVertices(mesh, format, buffer);
 
     GLuint vbo = 0;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(float), buffer.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, buffer.size(), buffer.data(), GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     return vbo;
 }
 
-GLuint RenderObject::createVAO(const GLuint vbo)
+GLuint RenderObject::createIBO(const MeshBuffer& mesh, GLenum& indexType)
+{
+    if (!mesh.isIndexed())
+    {
+        indexType = 0;
+        return 0;
+    }
+
+    const std::vector<unsigned int>& indices = mesh.indices();
+    indexType = mesh.indexType();
+
+    GLuint ibo = 0;
+    glGenBuffers(1, &ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    if (indexType == GL_UNSIGNED_SHORT)
+    {
+        // Narrow to 16-bit indices when every vertex fits
+        std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return ibo;
+}
+
+GeometryBuffers RenderObject::uploadGeometry(const MeshBuffer& mesh, VertexFormat format, bool arena)
+{
+    GeometryBuffers buffers;
+    if (arena)
+    {
+        buffers.arena = &VertexArena::forLayout(format, mesh.hasColors());
+        buffers.allocation = buffers.arena->allocate(mesh, buffers.layout);
+        buffers.indexType = mesh.isIndexed() ? mesh.indexType() : 0;
+    }
+    else
+    {
+        buffers.vbo = createVBO(mesh, format, buffers.layout);
+        buffers.ibo = createIBO(mesh, buffers.indexType);
+    }
+    buffers.drawCount = (GLsizei)mesh.elementCount();
+    buffers.vertexCount = mesh.vertexCount();
+    buffers.bytes = buffers.vertexCount * buffers.layout.stride + (mesh.isIndexed() ? mesh.indices().size() * mesh.indexSize() : 0);
+    return buffers;
+}
+
+GLuint RenderObject::createVAO(const GLuint vbo, const GLuint ibo, const VertexLayout& layout)
 {
     GLuint vao = 0;
     // Create VAO/VBO (requires GL context/current)
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
-    //glGenBuffers(1, &m_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    //glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(float), interleaved.data(), GL_STATIC_DRAW);
-
-    GLsizei stride = 9 * sizeof(float);
-    // position at location 0
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(0));
-    // normal at location 1
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-    // color at location 2
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+
+    setupVertexAttributes(layout);
+
+    // the element buffer binding is part of the VAO state
+    if (ibo != 0)
+    {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    }
 
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     return vao;
 }
 
-GLuint RenderObject::createDispList(
-    const std::vector<PointDouble3D>& vertices,
-    const std::vector<PointDouble3D>& normals,
-    const std::vector<PointDouble3D>& colors)
+GLuint RenderObject::createDispList(const MeshBuffer& mesh)
 {
-    bool hasNormals = (normals.size() == vertices.size());
-    bool hasPerVertexColors = (colors.size() == vertices.size());
+    bool hasNormals = mesh.hasNormals();
+    bool hasPerVertexColors = mesh.hasColors();
+    size_t elementCount = mesh.elementCount();
+
+    const float* positions = mesh.positions();
+    const float* normals = mesh.normals();
+    const float* colors = mesh.colors();
 
     GLuint dispList = glGenLists(1);
     glNewList(dispList, GL_COMPILE);
     {
         glBegin(GL_TRIANGLES);
         {
-            if (hasPerVertexColors)
-            {
-                for (size_t i = 0; i < vertices.size(); ++i)
-                {
-                    if (hasNormals)
-                    {
-                        PointFloat3D normal(normals[i]);
-                        glNormal3f(normal.x, normal.y, normal.z);
-                    }
-
-                    PointFloat3D color(colors[i]);
-                    glColor3f(color.x, color.y, color.z);
-                    PointFloat3D vertex(vertices[i]);
-                    glVertex3f(vertex.x, vertex.y, vertex.z);
-                }
-            }
-            else
+            if (!hasPerVertexColors)
             {
                 PointFloat3D useColor(m_color);
                 glColor3f(useColor.x, useColor.y, useColor.z);
-                for (size_t i = 0; i < vertices.size(); ++i)
+            }
+
+            for (size_t e = 0; e < elementCount; ++e)
+            {
+                size_t i = mesh.vertexIndex(e);
+                if (hasNormals)
                 {
-                    if (hasNormals)
-                    {
-                        PointFloat3D normal(normals[i]);
-                        glNormal3f(normal.x, normal.y, normal.z);
-                    }
-                    PointFloat3D vertex(vertices[i]);
-                    glVertex3f(vertex.x, vertex.y, vertex.z);
+                    glNormal3fv(normals + i * 3);
                 }
+                if (hasPerVertexColors)
+                {
+                    glColor3fv(colors + i * 3);
+                }
+                glVertex3fv(positions + i * 3);
             }
         }
         glEnd();
@@ -433,4 +915,4 @@ GLuint RenderObject::createDispList(
     glEndList();
 
     return dispList;
-}
\ No newline at end of file
+}
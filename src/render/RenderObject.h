@@ -5,7 +5,12 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <glm/glm.hpp>
 #include "Point3D.h"
+#include "MeshBuffer.h"
+#include "VertexFormat.h"
+#include "RenderQueue.h"
+#include "GeometryCache.h"
 
 
 class RenderObject 
@@ -14,57 +19,181 @@ public:
     RenderObject(const std::string& name);
     virtual ~RenderObject();
 
-    virtual void Render();
-    virtual bool getVolume(PointDouble3D& min, PointDouble3D& max) const;
+    // Append the draw items of this object and its children (see RenderQueue)
+    virtual void collectDrawItems(std::vector<DrawItem>& items) const;
+
+    // Draw only this object's geometry with the current fixed-function matrices
+    virtual void renderGeometry() const;
+
+    // Incremented whenever this node or anything below it changes
+    unsigned int getRevision() const { return m_revision; }
+
+    // World space bounds of this object and all its children. Cached per node and
+    // only recomputed after invalidateBounds() was called on it or a descendant.
+    bool getVolume(PointDouble3D& min, PointDouble3D& max) const;
+
+    // Mark the bounds of this node (and, lazily, of every ancestor) as stale.
+    // Subclasses that edit m_mesh directly must call this.
+    void invalidateBounds();
+
+    // Bump the revision of this node and every ancestor
+    void markChanged();
 
     virtual void buildGraphicsResources(); // e.g., VBOs, VAOs
 
-    void addChild(const std::shared_ptr<RenderObject> child) { m_children.push_back(child); }
-    void removeChild(const size_t i)
-    {
-        if (i < m_children.size())
-        {
-            m_children.erase(m_children.begin() + i);
-        }
-    }
+    // The CPU half of buildGraphicsResources for this object and its
+    // children: fill in normals, weld and optimize the mesh and its levels.
+    // Needs no GL context, so loaders run it on their own thread and the
+    // render thread only uploads. Undone by any mesh setter.
+    void prepareGeometry();
+
+    // Release the GL resources of this object and all its children, keeping
+    // the meshes, so buildGraphicsResources() can recreate them (for
+    // another render method, for example)
+    void releaseGraphicsResources();
+
+    // GeometryCache key of the mesh; a content hash unless a generator
+    // can name its output by its parameters. Taken once from the mesh as
+    // given, before welding and optimization change it in place.
+    virtual uint64_t getGeometryKey() const;
+
+    void addChild(const std::shared_ptr<RenderObject> child);
+    void removeChild(const size_t i);
 
-    void setVertices(const std::vector<PointDouble3D>& vertices) { m_vertices = vertices; }
-    void setNormals(const std::vector<PointDouble3D>& normals) { m_normals = normals; }
-    void setTexCoords(const std::vector<PointDouble3D>& texCoords) { m_texCoords = texCoords; }
-    void setColors(const std::vector<PointDouble3D>& colors) { m_colors = colors; }
+    RenderObject* getParent() const { return m_parent; }
+    size_t getChildCount() const { return m_children.size(); }
+    RenderObject* getChild(size_t i) const { return m_children[i].get(); }
 
+    void setVertices(const std::vector<PointDouble3D>& vertices) { m_mesh.setPositions(vertices); invalidateMesh(); invalidateBounds(); }
+    void setNormals(const std::vector<PointDouble3D>& normals) { m_mesh.setNormals(normals); invalidateMesh(); markChanged(); }
+    void setTexCoords(const std::vector<PointDouble3D>& texCoords) { m_mesh.setTexCoords(texCoords); invalidateMesh(); markChanged(); }
+    void setColors(const std::vector<PointDouble3D>& colors) { m_mesh.setColors(colors); invalidateMesh(); markChanged(); }
+
+    // A single color is kept as a constant attribute instead of being replicated per vertex
     void setColors(const PointDouble3D& color)
     {
         m_color = color;
-        m_colors.clear();
-        m_colors.reserve(m_vertices.size());
-        for (size_t i = 0; i < m_vertices.size(); ++i)
-        {
-            m_colors.push_back(color);
-        }
+        m_mesh.clearColors();
+        markChanged();
     }
 
+    void setMesh(const MeshBuffer& mesh) { m_mesh = mesh; invalidateMesh(); invalidateBounds(); }
+    const MeshBuffer& getMesh() const { return m_mesh; }
+
+    // Local transform relative to the parent. Moving an object only updates
+    // matrices; the vertex data is always kept in object space.
     void setPosition(const PointDouble3D& position);
+    const PointDouble3D& getPosition() const { return m_position; }
+
+    void setLocalTransform(const glm::mat4& transform);
+    const glm::mat4& getLocalTransform() const { return m_localTransform; }
 
+    // Parent world transform * local transform, recomputed lazily
+    const glm::mat4& getWorldTransform() const;
+
+    // Index a triangle soup by its identical vertices; call before createDefaultNormal
+    void weldMesh();
     void createDefaultNormal();
+
+    // GPU vertex layout used by the VAO path; takes effect on the next buildGraphicsResources
+    void setVertexFormat(VertexFormat format) { m_vertexFormat = format; markChanged(); }
+    VertexFormat getVertexFormat() const { return m_vertexFormat; }
     
     unsigned int getObjectID() const { return m_objectID; }
-    void setObjectID(unsigned int id) { m_objectID = id; }
+    void setObjectID(unsigned int id) { m_objectID = id; markChanged(); }
+
+    // Coarser versions of the mesh, finest first. Level k >= 1 (the k-th call)
+    // is drawn while the projected diameter is below switchSize pixels, so the
+    // switch sizes must decrease. Only the VAO path draws levels above 0.
+    void addLod(const MeshBuffer& mesh, double switchSize);
+    void clearLods();
+    size_t getLodCount() const { return m_lods.size() + 1; } // including the base mesh
+
+    // False for node types whose mesh is not drawn per object (e.g. instancing)
+    virtual bool supportsLod() const { return true; }
+
+    // Level for a projected diameter in pixels; the thresholds are widened
+    // around the current level so objects near a switch size do not flicker.
+    // bias > 1 prefers finer levels.
+    unsigned int selectLod(double screenSize, float bias) const;
+
+    // Point the mesh fields of item (VAO, counts, layout) at the given level
+    virtual void applyLod(unsigned int level, DrawItem& item) const;
+
+    // Print a summary line for every buildGraphicsResources (on by default)
+    static void setLogResources(bool enabled) { s_logResources = enabled; }
+    static bool getLogResources() { return s_logResources; }
 
 protected:
+    // Object space bounds of the object's own geometry, without children
+    virtual bool computeLocalVolume(PointDouble3D& min, PointDouble3D& max) const;
+
+    // Mark the world transform (and world bounds) of this subtree as stale
+    void invalidateTransform();
+
+    // True when buildGraphicsResources created something the current render method can draw
+    bool hasDrawResources() const;
+
+    // Draw item for this object's own geometry, using the default shader
+    DrawItem makeDrawItem() const;
+
+    static bool s_logResources;
+
+    struct LodLevel
+    {
+        MeshBuffer mesh;
+        double switchSize = 0.0;
+        uint64_t geometryKey = 0;   // hash of the unprocessed mesh, 0 until taken
+        GLuint vao = 0;
+        GLuint vbo = 0;
+        GLuint ibo = 0;
+        std::shared_ptr<const GeometryBuffers> geometry; // owns vbo and ibo
+        VertexLayout layout;
+        GLsizei drawCount = 0;
+        GLenum indexType = 0;
+    };
+
+    // Upload every level that has no GPU buffers yet (VAO path)
+    void buildLodResources();
+
+    std::vector<LodLevel> m_lods;
+    mutable unsigned int m_currentLod = 0;
+
     std::string m_name;
 
-    std::vector<PointDouble3D> m_vertices;
-    std::vector<PointDouble3D> m_normals;
-    std::vector<PointDouble3D> m_texCoords;
-    std::vector<PointDouble3D> m_colors;
+    MeshBuffer m_mesh;
+    bool m_meshPrepared = false; // prepareMesh() ran since the last change of m_mesh or m_lods
+    uint64_t m_geometryKey = 0;  // getGeometryKey() of the unprocessed m_mesh, 0 until taken
+
+    // Subclasses that rewrite m_mesh directly must call this
+    void invalidateMesh() { m_meshPrepared = false; m_geometryKey = 0; }
+
+    // Take the cache keys of m_mesh and its levels while they are unprocessed
+    void takeGeometryKeys();
+
+    // Weld, fill in normals and optimize m_mesh and its levels; the CPU
+    // processing shared by prepareGeometry and buildGraphicsResources
+    void prepareMesh();
 
     PointDouble3D m_color;
     PointDouble3D m_position;
+
+    glm::mat4 m_localTransform = glm::mat4(1.0f);
+    mutable glm::mat4 m_worldTransform = glm::mat4(1.0f);
+    mutable bool m_worldDirty = true; // implies every descendant is dirty as well
     
     unsigned int m_objectID = 0; // Unique ID for selection
 
     std::vector<std::shared_ptr<RenderObject>> m_children;
+    RenderObject* m_parent = nullptr;
+
+    // Cached bounds; m_boundsDirty implies every ancestor is dirty as well
+    mutable PointDouble3D m_boundsMin;
+    mutable PointDouble3D m_boundsMax;
+    mutable bool m_hasBounds = false;
+    mutable bool m_boundsDirty = true;
+
+    unsigned int m_revision = 0;
 
     // VBO support
     size_t m_vboCount = 0;
@@ -72,23 +201,38 @@ protected:
     bool m_useVBO = true; // can be toggled for systems without VBO support
 
     GLuint m_vao = 0;
-    GLuint m_vbo = 0; // interleaved VBO (pos,norm,color)
+    GLuint m_vbo = 0; // interleaved VBO (pos,norm[,color])
+    GLuint m_ibo = 0; // element buffer, 0 for non-indexed meshes
+    std::shared_ptr<const GeometryBuffers> m_geometry; // owns m_vbo and m_ibo
     GLuint m_dispList = 0;
+    VertexFormat m_vertexFormat;
+    VertexLayout m_layout;     // layout of m_vbo
+    GLsizei m_drawCount = 0;   // vertices (glDrawArrays) or indices (glDrawElements)
+    GLenum m_indexType = 0;    // 0 for non-indexed meshes
+
+    // Draw from a range of the shared VertexArena of the layout (VAO path);
+    // objects that add attributes of their own to the VAO turn this off
+    bool m_useVertexArena = true;
+    bool useArena() const;
+
+    void createSmoothNormal();
+
+    GLuint createDispList(const MeshBuffer& mesh);
+
+    static GLuint createVBO(const MeshBuffer& mesh, VertexFormat format, VertexLayout& layout);
+
+    static GLuint createIBO(const MeshBuffer& mesh, GLenum& indexType);
 
-    GLuint createDispList(
-        const std::vector<PointDouble3D>& vertices,
-        const std::vector<PointDouble3D>& normals,
-        const std::vector<PointDouble3D>& colors);
+    // VBO and IBO of mesh, or a range of the VertexArena, ready to be
+    // handed to the GeometryCache
+    static GeometryBuffers uploadGeometry(const MeshBuffer& mesh, VertexFormat format, bool arena);
 
-    GLuint createVBO(
-        const std::vector<PointDouble3D>& vertices,
-        const std::vector<PointDouble3D>& normals,
-        const std::vector<PointDouble3D>& colors);
+    static GLuint createVAO(const GLuint vbo, const GLuint ibo, const VertexLayout& layout);
 
-    GLuint createVAO(const GLuint vbo);
+    void drawElements() const;
 
-    void RenderWithImmediate();
-    void RenderWithVBO();
-    void RenderWithVAO();
+    void RenderWithImmediate() const;
+    void RenderWithClientArray() const;
+    void RenderWithVBO() const;
     void cleanRenderResources();
 };
\ No newline at end of file
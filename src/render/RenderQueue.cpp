@@ -0,0 +1,338 @@
+#include "RenderQueue.h"
+#include "RenderObject.h"
+#include "SceneGraph.h"
+#include "../gl/Shader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+uint64_t RenderQueue::makeKey(GLuint program, GLuint vao, float depth)
+{
+    // Map the float to an unsigned integer with the same ordering
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+
+    return ((uint64_t)(program & 0xFFu) << 56) |
+           ((uint64_t)(vao & 0xFFFFFFu) << 32) |
+           (uint64_t)bits;
+}
+
+bool RenderQueue::build(const RenderObject& root)
+{
+    std::vector<const RenderObject*> previous;
+    previous.reserve(m_items.size());
+    for (const DrawItem& item : m_items)
+    {
+        previous.push_back(item.object);
+    }
+
+    m_items.clear();
+    root.collectDrawItems(m_items);
+
+    bool changed = previous.size() != m_items.size();
+    for (size_t i = 0; !changed && i < m_items.size(); ++i)
+    {
+        changed = previous[i] != m_items[i].object;
+    }
+
+    m_order.resize(m_items.size());
+    for (size_t i = 0; i < m_order.size(); ++i)
+    {
+        m_order[i] = (unsigned int)i;
+    }
+    return changed;
+}
+
+void RenderQueue::sort(const glm::mat4& view)
+{
+    for (DrawItem& item : m_items)
+    {
+        // distance in front of the camera, which looks down -z in eye space
+        glm::vec4 eye = view * (item.world * glm::vec4(item.center, 1.0f));
+        GLuint program = item.shader ? item.shader->getProgram() : 0;
+        item.key = makeKey(program, item.vao, -eye.z);
+    }
+
+    sortOrder();
+}
+
+void RenderQueue::sortOrder()
+{
+    std::sort(m_order.begin(), m_order.end(),
+        [this](unsigned int a, unsigned int b) { return m_items[a].key < m_items[b].key; });
+}
+
+void RenderQueue::selectLods(const glm::mat4& projection, const glm::mat4& view, int viewportHeight, float bias)
+{
+    glm::mat4 viewProjection = projection * view;
+    float pixelScale = (float)viewportHeight * std::fabs(projection[1][1]);
+    bool rekeyed = false;
+
+    for (DrawItem& item : m_items)
+    {
+        if (!item.visible || !item.object || item.instanceCount > 0 || item.object->getLodCount() < 2)
+            continue;
+
+        // Projected diameter of the bounding sphere in pixels; w is 1 for an
+        // orthographic projection and the view depth for a perspective one
+        glm::vec3 center = (item.boundsMin + item.boundsMax) * 0.5f;
+        float radius = 0.5f * glm::length(item.boundsMax - item.boundsMin);
+        float w = (viewProjection * glm::vec4(center, 1.0f)).w;
+        double screenSize = w > 1e-6f ? radius * pixelScale / w : 1e30;
+
+        GLuint previousVao = item.vao;
+        unsigned int level = item.object->selectLod(screenSize, bias);
+        item.object->applyLod(level, item);
+
+        // A level with its own VAO moves the item to another state group;
+        // the depth bits of the last sort are kept
+        if (item.vao != previousVao)
+        {
+            GLuint program = item.shader ? item.shader->getProgram() : 0;
+            item.key = (makeKey(program, item.vao, 0.0f) & ~0xFFFFFFFFull) | (item.key & 0xFFFFFFFFull);
+            rekeyed = true;
+        }
+    }
+
+    if (rekeyed)
+    {
+        sortOrder();
+    }
+}
+
+void RenderQueue::submit(const glm::mat4& projection, const glm::mat4& view)
+{
+    m_submittedTriangles = 0;
+
+    if (getRenderMethod() == RENDER_VAO)
+    {
+        submitShader(projection, view);
+    }
+    else
+    {
+        submitFixedFunction(view);
+    }
+}
+
+// Handles of the per-item uniforms, looked up when the shader changes
+struct ItemUniforms
+{
+    UniformMat4 mvp;
+    UniformMat4 model;
+    UniformVec3 selectColor;
+    UniformVec3 posScale;
+    UniformVec3 posOffset;
+    UniformFloat normalScale;
+    UniformInt octNormals;
+    UniformVec4 shapeParams;
+
+    void lookup(const Shader& shader)
+    {
+        mvp = shader.getUniform<UNIFORM_MAT4>("mvp");
+        model = shader.getUniform<UNIFORM_MAT4>("model");
+        selectColor = shader.getUniform<UNIFORM_VEC3>("selectColor");
+        posScale = shader.getUniform<UNIFORM_VEC3>("posScale");
+        posOffset = shader.getUniform<UNIFORM_VEC3>("posOffset");
+        normalScale = shader.getUniform<UNIFORM_FLOAT>("normalScale");
+        octNormals = shader.getUniform<UNIFORM_INT>("octNormals");
+        shapeParams = shader.getUniform<UNIFORM_VEC4>("shapeParams");
+    }
+};
+
+// Items whose per-object state fits the ObjectDataBuffer layout
+static bool usesObjectData(const DrawItem& item)
+{
+    return item.shader == Shader::GetDefaultShader() && item.instanceCount == 0 && item.layout != nullptr;
+}
+
+void RenderQueue::submitShader(const glm::mat4& projection, const glm::mat4& view)
+{
+    glm::mat4 viewProjection = projection * view;
+
+    // Per-object transforms, decode parameters, colors and IDs of the
+    // default shader items go into one buffer, written once per frame; their
+    // draws then only set the object index attribute
+    Shader* objectShader = Shader::GetObjectDataShader();
+    bool objectData = objectShader->getProgram() != 0;
+    if (objectData)
+    {
+        m_objectData.clear();
+        for (unsigned int index : m_order)
+        {
+            const DrawItem& item = m_items[index];
+            if (item.visible && item.vao != 0 && usesObjectData(item))
+            {
+                m_objectData.add(item);
+            }
+        }
+        m_objectData.upload();
+    }
+
+    Shader* currentShader = nullptr;
+    ItemUniforms uniforms;
+    GLuint currentVao = 0;
+    GLuint objectIndex = 0;
+    bool objectShaderReady = false;
+    for (unsigned int index : m_order)
+    {
+        const DrawItem& item = m_items[index];
+        if (!item.visible || !item.shader || item.vao == 0)
+            continue;
+
+        bool fromObjectData = objectData && usesObjectData(item);
+        Shader* shader = fromObjectData ? objectShader : item.shader;
+        if (shader != currentShader)
+        {
+            shader->setCurrent();
+            currentShader = shader;
+            uniforms.lookup(*shader);
+
+            if (fromObjectData && !objectShaderReady)
+            {
+                shader->set(shader->getUniform<UNIFORM_MAT4>("viewProjection"), &viewProjection[0][0]);
+                shader->set(shader->getUniform<UNIFORM_MAT4>("view"), &view[0][0]);
+                shader->set(shader->getUniform<UNIFORM_INT>("objectData"), 0);
+                m_objectData.bind(0);
+                objectShaderReady = true;
+            }
+        }
+        if (item.vao != currentVao)
+        {
+            glBindVertexArray(item.vao);
+            currentVao = item.vao;
+        }
+
+        if (fromObjectData)
+        {
+            // Constant attribute, the VAO has no array on location 3
+            glVertexAttribI1ui(3, objectIndex++);
+        }
+        else
+        {
+            glm::mat4 mvp = viewProjection * item.world;
+            glm::mat4 model = view * item.world;
+            currentShader->set(uniforms.mvp, &mvp[0][0]);
+            currentShader->set(uniforms.model, &model[0][0]);
+            if (item.instanceCount == 0)
+            {
+                currentShader->set(uniforms.selectColor, item.selectColor);
+            }
+
+            // Decode parameters of the vertex layout; items without a vertex
+            // buffer (impostors, procedural shapes) have none
+            if (item.layout)
+            {
+                const VertexLayout& layout = *item.layout;
+                currentShader->set(uniforms.posScale, layout.posScale);
+                currentShader->set(uniforms.posOffset, layout.posOffset);
+                currentShader->set(uniforms.normalScale, layout.normalScale);
+                currentShader->set(uniforms.octNormals, layout.octNormals ? 1 : 0);
+
+                // Without a color array the color attribute reads this constant value
+                if (!layout.hasColors)
+                {
+                    glVertexAttrib3fv(2, item.color);
+                }
+            }
+            else if (item.instanceCount == 0)
+            {
+                // Procedural shapes compute their vertices from gl_VertexID
+                currentShader->set(uniforms.shapeParams, &item.shapeParams[0]);
+                glVertexAttrib3fv(2, item.color);
+            }
+        }
+
+        m_submittedTriangles += (size_t)(item.count / 3) * (item.instanceCount > 0 ? item.instanceCount : 1);
+
+        if (item.instanceCount > 0)
+        {
+            if (item.indexType != 0)
+            {
+                glDrawElementsInstanced(GL_TRIANGLES, item.count, item.indexType, reinterpret_cast<void*>(0), item.instanceCount);
+            }
+            else
+            {
+                glDrawArraysInstanced(GL_TRIANGLES, 0, item.count, item.instanceCount);
+            }
+        }
+        else if (item.indexType != 0)
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, item.count, item.indexType, reinterpret_cast<void*>(item.indexOffset), item.baseVertex);
+        }
+        else
+        {
+            glDrawArrays(GL_TRIANGLES, item.baseVertex, item.count);
+        }
+    }
+
+    glBindVertexArray(0);
+    if (objectShaderReady)
+    {
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    if (currentShader && currentShader != Shader::GetDefaultShader())
+    {
+        Shader::GetDefaultShader()->setCurrent();
+    }
+}
+
+void RenderQueue::submitFixedFunction(const glm::mat4& view)
+{
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    // Lit colors go to attachment 0 only; attachment 1 holds the object IDs
+    // the SelectionBuffer reads, written by the second pass below
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    for (unsigned int index : m_order)
+    {
+        const DrawItem& item = m_items[index];
+        if (!item.visible || !item.object)
+            continue;
+
+        glm::mat4 modelView = view * item.world;
+        glLoadMatrixf(&modelView[0][0]);
+        item.object->renderGeometry();
+        m_submittedTriangles += (size_t)(item.count / 3);
+    }
+
+    // ID pass over the same geometry. With color material off and nothing
+    // but emission left in the material, lighting outputs exactly the select
+    // color whatever colors renderGeometry sets per vertex.
+    glPushAttrib(GL_LIGHTING_BIT | GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT);
+    glDrawBuffer(GL_COLOR_ATTACHMENT1);
+    glEnable(GL_LIGHTING);
+    glDisable(GL_COLOR_MATERIAL);
+    glDisable(GL_DITHER);
+    glDisable(GL_BLEND);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+
+    const GLfloat black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, black);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, black);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, black);
+
+    for (unsigned int index : m_order)
+    {
+        const DrawItem& item = m_items[index];
+        if (!item.visible || !item.object)
+            continue;
+
+        const GLfloat emission[4] = { item.selectColor[0], item.selectColor[1], item.selectColor[2], 1.0f };
+        glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, emission);
+
+        glm::mat4 modelView = view * item.world;
+        glLoadMatrixf(&modelView[0][0]);
+        item.object->renderGeometry();
+    }
+
+    glPopAttrib();
+
+    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    glPopMatrix();
+}
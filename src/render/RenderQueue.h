@@ -0,0 +1,103 @@
+#pragma once
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "VertexFormat.h"
+#include "ObjectDataBuffer.h"
+
+class RenderObject;
+class Shader;
+
+/**
+ * One draw call of the flattened scene.
+ *
+ * Items are produced by RenderObject::collectDrawItems() and drawn by
+ * RenderQueue without touching the scene tree again.
+ */
+struct DrawItem
+{
+    uint64_t key = 0;               // program | vao | depth, see RenderQueue::makeKey
+    glm::mat4 world = glm::mat4(1.0f);
+
+    Shader* shader = nullptr;       // nullptr for the fixed-function paths
+    GLuint vao = 0;
+    GLsizei count = 0;              // vertices or indices
+    GLenum indexType = 0;           // 0 for glDrawArrays
+    GLint baseVertex = 0;           // first vertex of the mesh in a shared VertexArena buffer
+    size_t indexOffset = 0;         // byte offset of the first index
+    GLsizei instanceCount = 0;      // > 0 for an instanced draw with per-instance select colors
+
+    unsigned int objectID = 0;
+    float selectColor[3] = { 0.0f, 0.0f, 0.0f };
+    float color[3] = { 1.0f, 1.0f, 1.0f }; // used when the layout has no color array
+    glm::vec4 shapeParams = glm::vec4(0.0f); // radius, slices, stacks of procedural shapes (no layout, no instances)
+    glm::vec3 center = glm::vec3(0.0f);    // object space bounds center, for depth sorting
+    glm::vec3 boundsMin = glm::vec3(0.0f); // world space bounds of the object's own geometry
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    bool visible = true;                   // result of frustum culling, see Bvh::cull
+
+    const VertexLayout* layout = nullptr;   // nullptr when the shader reads no vertex buffer
+    const RenderObject* object = nullptr;   // used by the fixed-function paths
+};
+
+/**
+ * RenderQueue is the linear, state sorted draw list of a SceneGraph.
+ *
+ * It is rebuilt only when the scene changes, re-sorted when the view
+ * changes and otherwise just submitted in a loop every frame. Items keep
+ * the order of the tree traversal, so indices stay stable as long as the
+ * tree structure does (the BVH refers to them); the sorted draw order is
+ * kept as a separate permutation.
+ */
+class RenderQueue
+{
+public:
+    void clear() { m_items.clear(); m_order.clear(); }
+
+    // Flatten the tree below root into draw items. Returns true when the
+    // objects themselves changed (added, removed or reordered), false when
+    // only their data did.
+    bool build(const RenderObject& root);
+
+    // Sort front to back by program, VAO and view depth
+    void sort(const glm::mat4& view);
+
+    // Choose the level of detail of every visible item from its projected
+    // diameter; bias scales the size (> 1 means finer levels). Items whose
+    // VAO changes are re-keyed and the draw order is sorted again.
+    void selectLods(const glm::mat4& projection, const glm::mat4& view, int viewportHeight, float bias);
+
+    // Issue the draw calls of all visible items; the VAO path uploads the
+    // per-object data of the default shader items once and sets per-item
+    // uniforms for the rest, the fixed-function paths load the modelview
+    // matrix per item and draw everything twice, lit into attachment 0 and
+    // with the select colors into attachment 1
+    void submit(const glm::mat4& projection, const glm::mat4& view);
+
+    size_t size() const { return m_items.size(); }
+
+    // Triangles drawn by the last submit(), instances included
+    size_t getSubmittedTriangles() const { return m_submittedTriangles; }
+    const std::vector<DrawItem>& items() const { return m_items; }
+    std::vector<DrawItem>& items() { return m_items; }
+
+    // 8 bits program, 24 bits VAO, 32 bits depth (front to back)
+    static uint64_t makeKey(GLuint program, GLuint vao, float depth);
+
+private:
+    // Sort m_order by the current item keys
+    void sortOrder();
+
+    void submitShader(const glm::mat4& projection, const glm::mat4& view);
+    void submitFixedFunction(const glm::mat4& view);
+
+    std::vector<DrawItem> m_items;      // in tree order
+    std::vector<unsigned int> m_order;  // indices into m_items in draw order
+    size_t m_submittedTriangles = 0;
+
+    // Per-object data of the default shader items, rewritten every submit
+    ObjectDataBuffer m_objectData;
+};
@@ -1,17 +1,68 @@
 #include "SceneGraph.h"
 #include "RenderObject.h"
 #include "Sphere.h"
+#include "InstancedRenderObject.h"
+#include "SphereImpostors.h"
+#include "MeshSimplifier.h"
+#include "GeometryCache.h"
+#include "VertexArena.h"
+#include "PointKernels.h"
+#include "SelectionBuffer.h"
 #include "../gl/Shader.h"
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <algorithm> 
+#include <chrono>
+#include <cmath>
+#include <atomic>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 
-const RenderMethod RENDER_METHOD = RENDER_VAO;
+// Read by editors building models on other threads (Sphere::isProcedural)
+static std::atomic<RenderMethod> s_renderMethod(RENDER_VAO);
 
+static const char* s_renderMethodNames[RENDER_METHOD_COUNT] = { "immediate", "client", "vbo", "vao" };
+
+RenderMethod getRenderMethod()
+{
+    return s_renderMethod;
+}
+
+const char* renderMethodName(RenderMethod method)
+{
+    return (unsigned)method < RENDER_METHOD_COUNT ? s_renderMethodNames[method] : "unknown";
+}
+
+bool parseRenderMethod(const char* name, RenderMethod& method)
+{
+    for (int i = 0; i < RENDER_METHOD_COUNT; ++i)
+    {
+        if (strcmp(name, s_renderMethodNames[i]) == 0)
+        {
+            method = (RenderMethod)i;
+            return true;
+        }
+    }
+    return false;
+}
+const VertexFormat VERTEX_FORMAT = VERTEX_FORMAT_FLOAT;
+
+
+// Set a lighting uniform on every shader the render queue may use. The
+// default shader is set last and stays current.
+static void setSceneUniform(const char* name, GLfloat value[3])
+{
+    Shader* shaders[] = { Shader::GetProceduralSphereShader(), Shader::GetImpostorShader(), Shader::GetInstancedShader(),
+                          Shader::GetObjectDataShader(), Shader::GetDefaultShader() };
+    for (Shader* shader : shaders)
+    {
+        shader->setCurrent();
+        shader->setUniformVec3f(name, value);
+    }
+}
 
 SceneGraph::SceneGraph()
     : m_width(0), m_height(0)
@@ -20,6 +71,12 @@ SceneGraph::SceneGraph()
 
 SceneGraph::~SceneGraph()
 {
+    // Editors may still hold models of the staging; leave nothing in them
+    // that needs this thread's context to delete
+    if (m_rootObject)
+    {
+        m_rootObject->releaseGraphicsResources();
+    }
 }
 
 GLuint SceneGraph::getFBO()
@@ -34,13 +91,15 @@ void SceneGraph::init(int width, int height)
 
     setup();
 
+    std::cout << "Point kernels: " << PointKernels::levelName(PointKernels::getLevel()) << std::endl;
+
     float lightPos[3] = { 500.0f, 500.0f, 500.0f };
     setLight(lightPos);
 }
 
 void SceneGraph::setup()
 {
-    if (RENDER_METHOD == RENDER_VAO)
+    if (getRenderMethod() == RENDER_VAO)
     {
         Shader::GetDefaultShader()->setCurrent();
     }
@@ -105,13 +164,16 @@ void SceneGraph::setupViewport(int width, int height)
 void SceneGraph::setLight(const float pos[3])
 {
     GLfloat lightPos[] = { pos[0], pos[1], pos[2], 1.0f }; // positional
+    m_lightPos[0] = pos[0];
+    m_lightPos[1] = pos[1];
+    m_lightPos[2] = pos[2];
 
-    if (RENDER_METHOD == RENDER_VAO)
+    if (getRenderMethod() == RENDER_VAO)
     {
         GLfloat lightColor[] = { 1.0f, 1.0f, 1.0f};
 
-        Shader::GetDefaultShader()->setUniformVec3f("lightColor", lightColor);
-        Shader::GetDefaultShader()->setUniformVec3f("lightPos", lightPos);
+        setSceneUniform("lightColor", lightColor);
+        setSceneUniform("lightPos", lightPos);
     }
     else
     {
@@ -134,23 +196,110 @@ void SceneGraph::setLight(const float pos[3])
     }
 }
 
-void SceneGraph::setupCamera()
+void SceneGraph::setRenderMethod(RenderMethod method)
+{
+    if (method == s_renderMethod || method >= RENDER_METHOD_COUNT)
+        return;
+
+    // Everything built for the old backend goes: the GPU driven path only
+    // exists on the shader path, the queue holds the old VAOs and counts
+    setGpuDriven(false);
+    m_queueValid = false;
+    if (m_rootObject)
+    {
+        m_rootObject->releaseGraphicsResources();
+    }
+
+    s_renderMethod = method;
+
+    // Program and matrix, lighting state of the new backend
+    if (method == RENDER_VAO)
+    {
+        Shader::GetDefaultShader()->setCurrent();
+    }
+    else
+    {
+        glUseProgram(0);
+    }
+    setupCamera();
+    setLight(m_lightPos);
+
+    if (m_rootObject)
+    {
+        m_rootObject->buildGraphicsResources();
+    }
+
+    printf("Render method: %s\n", renderMethodName(method));
+}
+
+RenderMethod SceneGraph::selectFastestRenderMethod(int frames)
 {
-    GLfloat eyePos[3] = { (GLfloat)m_width / 2.0f, (GLfloat)m_height / 2.0f, 500.0f };
-    //GLfloat targetPos[3] = { (GLfloat)m_width / 2.0f, (GLfloat)m_height / 2.0f, 0.0f };
-    //GLfloat upVec[3] = { 0.0f, 1.0f, 0.0f };
+    RenderMethod best = s_renderMethod;
+    if (m_fbo == 0 || !m_rootObject || frames <= 0)
+        return best;
 
-    // Set camera to look at center of the panel
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    // Camera positioned above the screen, looking toward the panel center
-    // gluLookAt((double)eyePos[0], (double)eyePos[1], (double)eyePos[2],
-    //           (double)targetPos[0], (double)targetPos[1], (double)targetPos[2],
-    //           (double)upVec[0], (double)upVec[1], (double)upVec[2]);
+    double bestMs = 0.0;
+    printf("Render method probe, %d frames each:\n", frames);
+    for (int i = 0; i < RENDER_METHOD_COUNT; ++i)
+    {
+        RenderMethod method = (RenderMethod)i;
+        setRenderMethod(method);
+
+        // The first frame builds the queue and touches every resource
+        render();
+        glFinish();
+
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            render();
+        }
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+        printf("  %-9s %8.3f ms/frame\n", renderMethodName(method), ms);
+        if (i == 0 || ms < bestMs)
+        {
+            best = method;
+            bestMs = ms;
+        }
+    }
+
+    setRenderMethod(best);
+    printf("  selected %s\n", renderMethodName(best));
+    return best;
+}
 
-    if (RENDER_METHOD == RENDER_VAO)
+bool SceneGraph::setGpuDriven(bool enable)
+{
+    if (enable && (getRenderMethod() != RENDER_VAO || !GpuDrivenRenderer::isSupported()))
     {
-        Shader::GetDefaultShader()->setUniformVec3f("viewPos", eyePos);
+        printf("GPU driven rendering needs the VAO render path and multi-draw indirect\n");
+        enable = false;
+    }
+
+    if (enable != m_gpuDriven)
+    {
+        m_gpuDriven = enable;
+        m_gpuRenderer.release();
+        m_queueValid = false; // rebuild restores the visibility of the items
+    }
+    return m_gpuDriven;
+}
+
+void SceneGraph::setupCamera()
+{
+    m_camera.setViewport(m_width, m_height);
+
+    if (getRenderMethod() == RENDER_VAO)
+    {
+        glm::vec3 eye = m_camera.getEyePosition();
+        GLfloat eyePos[3] = { eye.x, eye.y, eye.z };
+        setSceneUniform("viewPos", eyePos);
+    }
+    else
+    {
+        m_camera.loadFixedFunction();
     }
 }
 
@@ -161,6 +310,10 @@ void SceneGraph::render(bool selectionMode)
         return;
     }
 
+    // Edits published since the last frame; the previous snapshot stays in
+    // use until this point, so editing never waits for a frame in flight
+    updateSnapshot();
+
     // Bind FBO FIRST, then clear it
     glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
     
@@ -178,21 +331,66 @@ void SceneGraph::render(bool selectionMode)
 
         glViewport(0, 0, m_width, m_height);
 
-        // Set perspective projection
-        glMatrixMode(GL_PROJECTION);
-        //glLoadIdentity();
-        //double aspect = m_width > 0 && m_height > 0 ? (double)m_width / (double)m_height : 1.0;
-        //gluPerspective(45.0, aspect, 1.0, 2000.0);
-        //glOrtho(0, m_width, m_height, 0, -volume_sphere, volume_sphere); // Y-axis inverted for screen coordinates
-
-        glm::mat4 projection = glm::ortho(0.0f, (float)m_width, (float)m_height, 0.0f, -(float)volume_sphere, (float)volume_sphere);
-        GLfloat proj[16];
-        memcpy(proj, &projection, sizeof(GLfloat) * 16);
-        glLoadMatrixf(proj);
-
-        //setupCamera();
-
-        m_rootObject->Render();
+        // Matrices live on the CPU; only the fixed-function backends need
+        // them in GL state
+        m_camera.setViewport(m_width, m_height);
+        m_camera.setDepth((float)volume_sphere);
+        if (getRenderMethod() != RENDER_VAO)
+        {
+            m_camera.loadFixedFunction();
+        }
+        const glm::mat4& projection = m_camera.getProjection();
+        const glm::mat4& view = m_camera.getView();
+
+        // Flatten the tree only when something changed since the last frame,
+        // or when arena compaction moved the draw offsets of the items
+        if (!m_queueValid || m_rootObject->getRevision() != m_queueRevision ||
+            VertexArena::getGeneration() != m_arenaGeneration)
+        {
+            bool structureChanged = m_renderQueue.build(*m_rootObject);
+            if (structureChanged || m_bvh.empty())
+            {
+                m_bvh.build(m_renderQueue.items());
+            }
+            else
+            {
+                m_bvh.refit(m_renderQueue.items());
+                if (m_bvh.needsRebuild())
+                {
+                    m_bvh.build(m_renderQueue.items());
+                }
+            }
+
+            m_renderQueue.sort(view);
+            m_queueRevision = m_rootObject->getRevision();
+            m_arenaGeneration = VertexArena::getGeneration();
+            m_queueValid = true;
+
+            if (m_gpuDriven)
+            {
+                m_gpuRenderer.build(m_renderQueue.items());
+            }
+        }
+
+        Frustum frustum;
+        frustum.extract(m_camera.getViewProjection());
+        m_cullStats = m_bvh.cull(frustum, m_renderQueue.items());
+
+        // Objects on the GPU path are culled and drawn there; the queue only
+        // submits the rest
+        unsigned int gpuHidden = m_gpuDriven ? m_gpuRenderer.hideItems(m_renderQueue.items()) : 0;
+        m_renderQueue.selectLods(projection, view, m_height, m_lodBias);
+
+        if (m_gpuDriven)
+        {
+            m_gpuRenderer.render(projection, view);
+
+            unsigned int visible = m_cullStats.visible - gpuHidden + (unsigned int)m_gpuRenderer.getVisibleCount();
+            m_cullStats.culled = m_cullStats.visible + m_cullStats.culled - visible;
+            m_cullStats.visible = visible;
+        }
+
+        m_renderQueue.submit(projection, view);
     }
 
     // Flush OpenGL commands
@@ -212,27 +410,360 @@ void SceneGraph::render(bool selectionMode)
     glReadBuffer(GL_BACK);
 }
 
-void SceneGraph::buildScene()
+void SceneGraph::buildScene(SceneStaging& staging)
 {
-    m_rootObject = std::make_unique<RenderObject>("RootObject");
-    m_rootObject->setObjectID(1); // Assign ID 1 to triangle
-    m_rootObject->setVertices({
+    std::vector<std::shared_ptr<RenderObject>> models;
+
+    std::shared_ptr<RenderObject> triangle = std::make_shared<RenderObject>("triangle");
+    triangle->setObjectID(1); // Assign ID 1 to triangle
+    triangle->setVertices({
         PointDouble3D(0.0, 0.0, 0.0),
         PointDouble3D(0.0, 200.0, 0.0),
         PointDouble3D(200.0, 200.0, 0.0)
         });
 
-    m_rootObject->setColors({
+    triangle->setColors({
         PointDouble3D(1.0, 0.0, 0.0), // Red
         PointDouble3D(0.0, 1.0, 0.0), // Green
         PointDouble3D(0.0, 0.0, 1.0)  // Blue
         });
+    models.push_back(triangle);
 
     std::shared_ptr<Sphere> mySphere = std::make_shared<Sphere>("unit_sphere", 100.0 /* radius */, 32 /* slices */, 16 /* stacks */);
     mySphere->setObjectID(2); // Assign ID 2 to sphere
     mySphere->setColors({ PointDouble3D(0.8, 0.2, 0.2) }); // Reddish color
     mySphere->setPosition(PointDouble3D(100.0, 100.0, 0.0));
-    m_rootObject->addChild(mySphere);
+    models.push_back(mySphere);
+
+    // A procedural sphere: generated by the vertex shader, no vertex buffers
+    std::shared_ptr<Sphere> proceduralSphere = std::make_shared<Sphere>("procedural_sphere", 60.0, 64, 32);
+    proceduralSphere->setProcedural(true);
+    proceduralSphere->setObjectID(3);
+    proceduralSphere->setColors({ PointDouble3D(0.2, 0.7, 0.3) });
+    proceduralSphere->setPosition(PointDouble3D(100.0, 320.0, 0.0));
+    models.push_back(proceduralSphere);
+
+    // A small grid of instanced spheres; every instance can be picked by its own ID
+    std::shared_ptr<InstancedRenderObject> spheres = std::make_shared<InstancedRenderObject>("sphere_grid");
+    MeshBuffer unitSphere;
+    Sphere::BuildMesh(unitSphere, 1.0, 16, 8);
+    spheres->setMesh(unitSphere);
+    for (int i = 0; i < 8; ++i)
+    {
+        for (int j = 0; j < 8; ++j)
+        {
+            InstancedRenderObject::Instance instance;
+            instance.position = PointDouble3D(300.0 + 25.0 * j, 40.0 + 25.0 * i, 0.0);
+            instance.scale = 10.0;
+            instance.color = PointDouble3D(0.2 + 0.1 * j, 0.3, 0.9 - 0.1 * i);
+            instance.objectID = 100 + i * 8 + j; // IDs 100..163
+            spheres->addInstance(instance);
+        }
+    }
+    models.push_back(spheres);
+
+    // The same kind of grid as ray-cast impostors
+    std::shared_ptr<SphereImpostors> impostors = std::make_shared<SphereImpostors>("impostor_grid");
+    for (int i = 0; i < 8; ++i)
+    {
+        for (int j = 0; j < 8; ++j)
+        {
+            InstancedRenderObject::Instance instance;
+            instance.position = PointDouble3D(300.0 + 25.0 * j, 260.0 + 25.0 * i, 0.0);
+            instance.scale = 10.0;
+            instance.color = PointDouble3D(0.9 - 0.1 * i, 0.6, 0.2 + 0.1 * j);
+            instance.objectID = 200 + i * 8 + j; // IDs 200..263
+            impostors->addInstance(instance);
+        }
+    }
+    models.push_back(impostors);
+
+    generateLods(models);
+    for (const std::shared_ptr<RenderObject>& model : models)
+    {
+        model->prepareGeometry();
+        staging.addModel(model);
+    }
+    staging.publish();
+}
+
+static void collectNodes(RenderObject* node, std::vector<RenderObject*>& nodes)
+{
+    nodes.push_back(node);
+    for (size_t i = 0; i < node->getChildCount(); ++i)
+    {
+        if (node->getChild(i))
+        {
+            collectNodes(node->getChild(i), nodes);
+        }
+    }
+}
+
+void SceneGraph::generateLods(const std::vector<std::shared_ptr<RenderObject>>& models)
+{
+    std::vector<RenderObject*> nodes;
+    for (const std::shared_ptr<RenderObject>& model : models)
+    {
+        if (model)
+        {
+            collectNodes(model.get(), nodes);
+        }
+    }
+    MeshSimplifier::generateLods(nodes, MeshSimplifier::LodSettings());
+}
+
+void SceneGraph::setStaging(std::shared_ptr<SceneStaging> staging)
+{
+    m_staging = staging;
+    updateSnapshot();
+
+    GeometryCache::global().printStats();
+    VertexArena::printStats();
+}
+
+bool SceneGraph::updateSnapshot()
+{
+    std::shared_ptr<const SceneSnapshot> snapshot = m_staging ? m_staging->getPublished() : nullptr;
+    if (!snapshot || snapshot == m_snapshot)
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!m_rootObject)
+    {
+        m_rootObject = std::make_unique<RenderObject>("RootObject");
+    }
+
+    std::unordered_map<unsigned int, std::shared_ptr<RenderObject>> nodes;
+    std::vector<std::shared_ptr<RenderObject>> order;
+    unsigned int uploaded = 0;
+    for (const SceneModel& model : snapshot->models)
+    {
+        if (!model.root)
+            continue;
+
+        // A model whose subtree did not change keeps its node, GL resources
+        // and cached transforms
+        std::shared_ptr<RenderObject> node;
+        auto found = m_modelNodes.find(model.id);
+        if (found != m_modelNodes.end() && found->second->getChildCount() > 0 && found->second->getChild(0) == model.root.get())
+        {
+            node = found->second;
+        }
+        else
+        {
+            // Published roots are write-once and adopted only here. A root
+            // that moved from another id still hangs below that id's node
+            // of the previous snapshot, which is dropped below.
+            if (model.root->getParent())
+            {
+                for (const auto& previous : m_modelNodes)
+                {
+                    if (previous.second->getChildCount() > 0 && previous.second->getChild(0) == model.root.get())
+                    {
+                        previous.second->removeChild(0);
+                        break;
+                    }
+                }
+            }
+            assert(model.root->getParent() == nullptr && "a published root is owned by one model only");
+
+            node = std::make_shared<RenderObject>("model");
+            node->addChild(model.root);
+            model.root->buildGraphicsResources();
+            ++uploaded;
+        }
+
+        if (node->getLocalTransform() != model.transform)
+        {
+            node->setLocalTransform(model.transform);
+        }
+        nodes[model.id] = node;
+        order.push_back(node);
+    }
+
+    // Re-parent only when models were added, removed or replaced, so that a
+    // moved model does not invalidate the caches of all the others
+    bool sameModels = order.size() == m_rootObject->getChildCount();
+    for (size_t i = 0; sameModels && i < order.size(); ++i)
+    {
+        sameModels = m_rootObject->getChild(i) == order[i].get();
+    }
+    if (!sameModels)
+    {
+        while (m_rootObject->getChildCount() > 0)
+        {
+            m_rootObject->removeChild(m_rootObject->getChildCount() - 1);
+        }
+        for (const std::shared_ptr<RenderObject>& node : order)
+        {
+            m_rootObject->addChild(node);
+        }
+    }
+
+    // Dropping the previous snapshot deletes the models only it held
+    m_modelNodes.swap(nodes);
+    m_snapshot = snapshot;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("Scene snapshot %u: %u models, %u uploaded, %.3f ms\n",
+        snapshot->version, (unsigned)snapshot->models.size(), uploaded, ms);
+    return true;
+}
+
+void SceneGraph::benchmarkPicking(SelectionBuffer& selection, int frames)
+{
+    if (m_fbo == 0 || !selection.isValid() || frames <= 0)
+        return;
+
+    // Picks sweep the viewport as a moving mouse would
+    auto pickPosition = [this, frames](int frame, int& x, int& y) {
+        x = (int)((long long)m_width * frame / frames);
+        y = m_height / 2;
+    };
+
+    render();
+    glFinish();
+
+    unsigned int hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        render();
+        int x, y;
+        pickPosition(frame, x, y);
+        hits += selection.readObjectID(x, y) != 0 ? 1 : 0;
+    }
+    glFinish();
+    double syncMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+    unsigned int asyncHits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        render();
+        selection.pollPicks();
+        int x, y;
+        pickPosition(frame, x, y);
+        selection.readObjectIDAsync(x, y, [&asyncHits](unsigned int objectID) { asyncHits += objectID != 0 ? 1 : 0; });
+    }
+    selection.pollPicks(true);
+    glFinish();
+    double asyncMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+    printf("Picking benchmark, %d frames with one pick each:\n", frames);
+    printf("  glReadPixels: %8.3f ms/frame, %u hits\n", syncMs, hits);
+    printf("  PBO + fence:  %8.3f ms/frame, %u hits%s\n", asyncMs, asyncHits,
+        SelectionBuffer::supportsAsyncRead() ? "" : " (no fence sync, synchronous fallback)");
+}
 
-    m_rootObject->buildGraphicsResources();
+// Average time of drawing the queue, including the wait for the GPU to finish
+static double timeQueue(RenderQueue& queue, const glm::mat4& projection, const glm::mat4& view, int frames)
+{
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; ++f)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        queue.submit(projection, view);
+    }
+    glFinish();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+}
+
+void SceneGraph::benchmarkInstancing(unsigned int count, int frames)
+{
+    if (getRenderMethod() != RENDER_VAO || m_fbo == 0 || count == 0 || frames <= 0)
+    {
+        printf("Instancing benchmark needs the VAO render path\n");
+        return;
+    }
+
+    const double radius = 4.0;
+    const int slices = 16;
+    const int stacks = 8;
+    unsigned int side = (unsigned int)std::ceil(std::sqrt((double)count));
+    double spacing = std::min(m_width, m_height) / (double)side;
+
+    // Same spheres as individual nodes, as instances of one mesh and as impostors
+    bool logResources = RenderObject::getLogResources();
+    RenderObject::setLogResources(false);
+
+    auto start = std::chrono::steady_clock::now();
+    RenderObject perObject("benchmark_objects");
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        std::shared_ptr<Sphere> sphere = std::make_shared<Sphere>("benchmark_sphere", radius, slices, stacks);
+        sphere->setObjectID(i + 1);
+        sphere->setPosition(PointDouble3D(spacing * (i % side + 0.5), spacing * (i / side + 0.5), 0.0));
+        perObject.addChild(sphere);
+    }
+    perObject.buildGraphicsResources();
+    double perObjectBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    InstancedRenderObject instanced("benchmark_instances");
+    MeshBuffer unitSphere;
+    Sphere::BuildMesh(unitSphere, 1.0, slices, stacks);
+    instanced.setMesh(unitSphere);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        InstancedRenderObject::Instance instance;
+        instance.position = PointDouble3D(spacing * (i % side + 0.5), spacing * (i / side + 0.5), 0.0);
+        instance.scale = radius;
+        instance.color = PointDouble3D(0.8, 0.2, 0.2);
+        instance.objectID = i + 1;
+        instanced.addInstance(instance);
+    }
+    instanced.buildGraphicsResources();
+    double instancedBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    SphereImpostors impostors("benchmark_impostors");
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        InstancedRenderObject::Instance instance;
+        instance.position = PointDouble3D(spacing * (i % side + 0.5), spacing * (i / side + 0.5), 0.0);
+        instance.scale = radius;
+        instance.color = PointDouble3D(0.8, 0.2, 0.2);
+        instance.objectID = i + 1;
+        impostors.addInstance(instance);
+    }
+    impostors.buildGraphicsResources();
+    double impostorBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    RenderObject::setLogResources(logResources);
+
+    // Measured through the scene camera, like the frames it stands in for
+    const glm::mat4& projection = m_camera.getProjection();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, m_width, m_height);
+
+    RenderQueue queue;
+    queue.build(perObject);
+    queue.sort(m_camera.getView());
+    size_t perObjectDraws = queue.size();
+    double perObjectMs = timeQueue(queue, projection, m_camera.getView(), frames);
+
+    queue.build(instanced);
+    queue.sort(m_camera.getView());
+    size_t instancedDraws = queue.size();
+    double instancedMs = timeQueue(queue, projection, m_camera.getView(), frames);
+
+    queue.build(impostors);
+    queue.sort(m_camera.getView());
+    size_t impostorDraws = queue.size();
+    double impostorMs = timeQueue(queue, projection, m_camera.getView(), frames);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    printf("Instancing benchmark, %u spheres (%d x %d), %d frames:\n", count, slices, stacks, frames);
+    printf("  per object: %8.3f ms/frame, %u draw calls, build %.1f ms\n", perObjectMs, (unsigned)perObjectDraws, perObjectBuildMs);
+    printf("  instanced:  %8.3f ms/frame, %u draw calls, build %.1f ms\n", instancedMs, (unsigned)instancedDraws, instancedBuildMs);
+    printf("  impostors:  %8.3f ms/frame, %u draw calls, build %.1f ms\n", impostorMs, (unsigned)impostorDraws, impostorBuildMs);
+    if (instancedMs > 0.0 && impostorMs > 0.0)
+    {
+        printf("  speedup: %.1fx instanced, %.1fx impostors\n", perObjectMs / instancedMs, perObjectMs / impostorMs);
+    }
+    GeometryCache::global().printStats();
 }
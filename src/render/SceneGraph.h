@@ -2,18 +2,38 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <memory>
+#include <unordered_map>
 #include "RenderObject.h"
+#include "VertexFormat.h"
+#include "RenderQueue.h"
+#include "Bvh.h"
+#include "GpuDrivenRenderer.h"
+#include "Camera.h"
+#include "SceneSnapshot.h"
+#include <glm/glm.hpp>
 
 
 enum RenderMethod
 {
-    RENDER_IMMEDIATE,
-    RENDER_CLIENT_ARRAY,
+    RENDER_IMMEDIATE,       // display lists
+    RENDER_CLIENT_ARRAY,    // vertex arrays in client memory
     RENDER_VBO,
-    RENDER_VAO
+    RENDER_VAO,             // shaders; the only path with instancing, LODs and arenas
+    RENDER_METHOD_COUNT
 };
 
-extern const RenderMethod RENDER_METHOD;
+// Backend used by all render objects. Switched at runtime with
+// SceneGraph::setRenderMethod, which rebuilds the GL resources.
+RenderMethod getRenderMethod();
+
+// "immediate", "client", "vbo" or "vao", as accepted by --render=
+const char* renderMethodName(RenderMethod method);
+bool parseRenderMethod(const char* name, RenderMethod& method);
+
+class SelectionBuffer;
+
+// Default GPU vertex layout for new render objects (VAO path only)
+extern const VertexFormat VERTEX_FORMAT;
 
 class SceneGraph 
 {
@@ -22,19 +42,96 @@ public:
     ~SceneGraph();
 
     void init(int width, int height);
+
+    // Draws the latest snapshot published to the staging, switching to a
+    // new one between frames
     void render(bool selectionMode = false);
-    void buildScene();
+
+    // Stage the demo models, with level of detail chains and prepared
+    // meshes, and publish them. Needs no GL context.
+    static void buildScene(SceneStaging& staging);
+
+    // Simplify every mesh below the given models that has no level of
+    // detail chain into one (in parallel); call before publishing them
+    static void generateLods(const std::vector<std::shared_ptr<RenderObject>>& models);
+
+    // Render the snapshots published to staging from now on; installs the
+    // current one right away. Needs the GL context.
+    void setStaging(std::shared_ptr<SceneStaging> staging);
 
     void setupViewport(int width, int height);
+
+    // Switch the backend of the whole scene: releases all GL resources,
+    // then rebuilds them for the new method. Needs the GL context.
+    void setRenderMethod(RenderMethod method);
+
+    // Render frames with every backend, keep the fastest and return it
+    RenderMethod selectFastestRenderMethod(int frames);
     void setLight(const float pos[3]);
 
     GLuint getFBO();
 
+    // Draw count spheres as separate objects, as one instanced object and as
+    // impostors into the FBO and print the frame times of each
+    void benchmarkInstancing(unsigned int count, int frames);
+
+    // Render frames with one pick per frame, read with glReadPixels and with
+    // pixel buffer readback, and print the frame times of both
+    void benchmarkPicking(SelectionBuffer& selection, int frames);
+
+    // Result of the frustum culling of the last rendered frame
+    const Bvh::CullStats& getCullStats() const { return m_cullStats; }
+
+    // Triangles drawn in the last rendered frame
+    size_t getSubmittedTriangles() const { return m_renderQueue.getSubmittedTriangles(); }
+
+    // Global level of detail bias: projected sizes are multiplied by it, so
+    // values above 1 select finer levels and values below 1 coarser ones
+    void setLodBias(float bias) { m_lodBias = bias; }
+    float getLodBias() const { return m_lodBias; }
+
+    // Draw the static indexed objects with GPU culling and multi-draw
+    // indirect (see GpuDrivenRenderer); only when isSupported() and on the
+    // VAO path. Returns whether the mode is now on.
+    bool setGpuDriven(bool enable);
+    bool isGpuDriven() const { return m_gpuDriven; }
+
 private:
     void setup();
     void setupCamera();
 
+    // Switch to the latest published snapshot if it is newer than the drawn
+    // one. Models still in it keep their nodes and GL resources, new ones
+    // are uploaded, removed ones are released here with the context current.
+    bool updateSnapshot();
+
+    // Renderer side of the scene: the root owns one placement node per
+    // model, whose only child is the model's subtree
     std::unique_ptr<RenderObject> m_rootObject;
+    std::shared_ptr<SceneStaging> m_staging;
+    std::shared_ptr<const SceneSnapshot> m_snapshot;
+    std::unordered_map<unsigned int, std::shared_ptr<RenderObject>> m_modelNodes;
+
+    // Flattened draw list, rebuilt when the root revision changes
+    RenderQueue m_renderQueue;
+    unsigned int m_queueRevision = 0;
+    unsigned int m_arenaGeneration = 0;
+    bool m_queueValid = false;
+
+    // Projection and view of every frame, computed on the CPU
+    Camera m_camera;
+
+    // Hierarchy over the queue items, refitted when objects only move
+    Bvh m_bvh;
+    Bvh::CullStats m_cullStats;
+
+    float m_lodBias = 1.0f;
+
+    GpuDrivenRenderer m_gpuRenderer;
+    bool m_gpuDriven = false;
+
+    float m_lightPos[3] = { 500.0f, 500.0f, 500.0f };
+
     int m_width;
     int m_height;
     GLuint m_fbo = 0;
@@ -0,0 +1,90 @@
+#include "SceneSnapshot.h"
+#include "RenderObject.h"
+#include <algorithm>
+
+unsigned int SceneStaging::addModel(std::shared_ptr<RenderObject> root, const glm::mat4& transform)
+{
+    if (!root || isStaged(root.get(), 0))
+        return 0;
+
+    SceneModel model;
+    model.id = m_nextId++;
+    model.root = root;
+    model.transform = transform;
+    m_models.push_back(model);
+    m_changed = true;
+    return model.id;
+}
+
+bool SceneStaging::replaceModel(unsigned int id, std::shared_ptr<RenderObject> root)
+{
+    SceneModel* model = findModel(id);
+    if (!model || !root || isStaged(root.get(), id))
+        return false;
+
+    model->root = root;
+    m_changed = true;
+    return true;
+}
+
+bool SceneStaging::setModelTransform(unsigned int id, const glm::mat4& transform)
+{
+    SceneModel* model = findModel(id);
+    if (!model)
+        return false;
+
+    model->transform = transform;
+    m_changed = true;
+    return true;
+}
+
+bool SceneStaging::removeModel(unsigned int id)
+{
+    auto found = std::find_if(m_models.begin(), m_models.end(), [id](const SceneModel& model) { return model.id == id; });
+    if (found == m_models.end())
+        return false;
+
+    m_models.erase(found);
+    m_changed = true;
+    return true;
+}
+
+std::shared_ptr<const SceneSnapshot> SceneStaging::publish()
+{
+    if (!m_changed)
+        return getPublished();
+
+    std::shared_ptr<SceneSnapshot> snapshot = std::make_shared<SceneSnapshot>();
+    snapshot->version = ++m_version;
+    snapshot->models = m_models;
+
+    std::shared_ptr<const SceneSnapshot> published = snapshot;
+    std::atomic_store(&m_published, published);
+    m_changed = false;
+    return published;
+}
+
+std::shared_ptr<const SceneSnapshot> SceneStaging::getPublished() const
+{
+    return std::atomic_load(&m_published);
+}
+
+SceneModel* SceneStaging::findModel(unsigned int id)
+{
+    for (SceneModel& model : m_models)
+    {
+        if (model.id == id)
+            return &model;
+    }
+    return nullptr;
+}
+
+bool SceneStaging::isStaged(const RenderObject* root, unsigned int exceptId) const
+{
+    for (const SceneModel& model : m_models)
+    {
+        if (model.id != exceptId && model.root.get() == root)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <glm/glm.hpp>
+
+class RenderObject;
+
+// One top-level object of the scene. Once published, the subtree below
+// root belongs to the renderer, which parents it, builds its GL resources
+// and caches in it; editors change a model by replacing it, never by
+// touching or reading it. A root is published under one id at a time.
+struct SceneModel
+{
+    unsigned int id = 0;
+    std::shared_ptr<RenderObject> root;
+    glm::mat4 transform = glm::mat4(1.0f); // placement in the scene, applied by the renderer
+};
+
+/**
+ * Immutable version of the scene as seen by the renderer. Consecutive
+ * snapshots share the subtree of every model that did not change; only
+ * the model list itself is copied.
+ */
+struct SceneSnapshot
+{
+    unsigned int version = 0;
+    std::vector<SceneModel> models;
+};
+
+/**
+ * Staging side of the scene. Editors (one thread at a time) add, replace,
+ * move and remove models without affecting the frame being rendered, and
+ * publish() then hands all of their changes to the renderer at once by
+ * swapping the published snapshot atomically.
+ *
+ * The last reference to a model that was rendered should be dropped on the
+ * render thread, which owns its GL resources; SceneGraph takes care of that
+ * as long as it holds the staging longer than the editors do.
+ */
+class SceneStaging
+{
+public:
+    // Models should be complete and prepared (RenderObject::prepareGeometry)
+    // so that publishing them only costs the renderer an upload. Returns 0
+    // for a null root or one that is already staged under another id.
+    unsigned int addModel(std::shared_ptr<RenderObject> root, const glm::mat4& transform = glm::mat4(1.0f));
+
+    // New version of a model; the previous one is released by the renderer.
+    // Fails like addModel for a root staged under another id.
+    bool replaceModel(unsigned int id, std::shared_ptr<RenderObject> root);
+    bool setModelTransform(unsigned int id, const glm::mat4& transform);
+    bool removeModel(unsigned int id);
+
+    size_t getModelCount() const { return m_models.size(); }
+    bool hasChanges() const { return m_changed; }
+
+    // Make the staged models the current snapshot and return it. Costs one
+    // copy of the model list; without changes the current one is returned.
+    std::shared_ptr<const SceneSnapshot> publish();
+
+    // Latest published snapshot, callable from any thread
+    std::shared_ptr<const SceneSnapshot> getPublished() const;
+
+private:
+    SceneModel* findModel(unsigned int id);
+    bool isStaged(const RenderObject* root, unsigned int exceptId) const;
+
+    std::vector<SceneModel> m_models;
+    unsigned int m_nextId = 1;
+    unsigned int m_version = 0;
+    bool m_changed = false;
+
+    // Only accessed through std::atomic_load / std::atomic_store
+    std::shared_ptr<const SceneSnapshot> m_published;
+};
@@ -71,6 +71,115 @@ unsigned int SelectionBuffer::readObjectID(int x, int y)
     return colorToObjectID(pixel[0], pixel[1], pixel[2]);
 }
 
+bool SelectionBuffer::supportsAsyncRead()
+{
+    return GLEW_VERSION_3_2 || GLEW_ARB_sync;
+}
+
+void SelectionBuffer::readObjectIDAsync(int x, int y, PickCallback callback)
+{
+    if (m_fbo == 0 || x < 0 || x >= m_width || y < 0 || y >= m_height || !supportsAsyncRead())
+    {
+        callback(readObjectID(x, y));
+        return;
+    }
+
+    PendingPick pick;
+    if (m_freePbos.empty())
+    {
+        glGenBuffers(1, &pick.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pick.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 4, nullptr, GL_STREAM_READ);
+        m_pbos.push_back(pick.pbo);
+    }
+    else
+    {
+        pick.pbo = m_freePbos.back();
+        m_freePbos.pop_back();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pick.pbo);
+    }
+
+    // Flip Y coordinate (OpenGL uses bottom-left origin)
+    int flippedY = m_height - y - 1;
+
+    // With a pack buffer bound glReadPixels only queues the copy
+    bind();
+    glReadPixels(x, flippedY, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    unbind();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pick.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pick.callback = callback;
+    m_pending.push_back(pick);
+
+    // Make sure the fence reaches the GPU even if no frame follows
+    glFlush();
+}
+
+std::future<unsigned int> SelectionBuffer::readObjectIDAsync(int x, int y)
+{
+    std::shared_ptr<std::promise<unsigned int>> promise = std::make_shared<std::promise<unsigned int>>();
+    std::future<unsigned int> future = promise->get_future();
+    readObjectIDAsync(x, y, [promise](unsigned int objectID) { promise->set_value(objectID); });
+    return future;
+}
+
+unsigned int SelectionBuffer::pollPicks(bool wait)
+{
+    unsigned int delivered = 0;
+    bool expired = false;
+    while (!m_pending.empty())
+    {
+        PendingPick& pick = m_pending.front();
+
+        // Fences signal in order, so the first one still pending ends the poll.
+        // A wait gives up after one timeout (lost or reset context); that read
+        // and every later unsignaled one are delivered as 0.
+        GLuint64 timeout = (wait && !expired) ? 1000000000ull : 0; // 1 s
+        GLenum status = glClientWaitSync(pick.fence, 0, timeout);
+        bool signaled = (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED);
+        if (!signaled)
+        {
+            if (status == GL_WAIT_FAILED)
+                std::cerr << "SelectionBuffer::pollPicks - glClientWaitSync failed" << std::endl;
+            else if (!wait)
+                break;
+            else
+            {
+                if (!expired)
+                    std::cerr << "SelectionBuffer::pollPicks - timed out, dropping " << m_pending.size() << " pending reads" << std::endl;
+                expired = true;
+            }
+        }
+
+        unsigned int objectID = 0;
+        if (signaled)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pick.pbo);
+            const unsigned char* pixel = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4, GL_MAP_READ_BIT));
+            if (pixel)
+            {
+                objectID = colorToObjectID(pixel[0], pixel[1], pixel[2]);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            m_freePbos.push_back(pick.pbo);
+        }
+        // An unsignaled buffer may still be written; it is not reused and
+        // only deleted with the others in cleanup()
+
+        glDeleteSync(pick.fence);
+        PickCallback callback = pick.callback;
+        m_pending.pop_front();
+
+        // After the pop, a callback may queue the next read
+        callback(objectID);
+        ++delivered;
+    }
+    return delivered;
+}
+
 void SelectionBuffer::objectIDToColor(unsigned int id, float color[3])
 {
     // Convert ID to RGB (24-bit color space allows up to 16,777,216 unique objects)
@@ -89,6 +198,15 @@ unsigned int SelectionBuffer::colorToObjectID(unsigned char r, unsigned char g,
 
 void SelectionBuffer::cleanup()
 {
+    // Nobody waits forever for a read that was already queued
+    pollPicks(true);
+    if (!m_pbos.empty())
+    {
+        glDeleteBuffers((GLsizei)m_pbos.size(), m_pbos.data());
+        m_pbos.clear();
+        m_freePbos.clear();
+    }
+
     m_width = 0;
     m_height = 0;
 }
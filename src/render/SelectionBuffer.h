@@ -2,11 +2,19 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <future>
 
 /**
  * SelectionBuffer manages an off-screen framebuffer for object selection.
  * Objects are rendered with unique color IDs, which can be read back
  * to determine which object is at a given pixel coordinate.
+ *
+ * readObjectID reads synchronously and waits for the GPU to finish every
+ * queued command. readObjectIDAsync queues the read into a pixel buffer
+ * object behind a fence instead; pollPicks delivers the result once the
+ * fence has passed, normally by the next frame.
  */
 class SelectionBuffer
 {
@@ -29,6 +37,25 @@ public:
     // Read the object ID at given screen coordinates
     // Returns 0 if no object, otherwise the object ID
     unsigned int readObjectID(int x, int y);
+
+    // Receives the object ID of an asynchronous read, 0 for no object
+    typedef std::function<void(unsigned int)> PickCallback;
+
+    // Queue a read of the object ID at the given screen coordinates; the
+    // callback is called from pollPicks() on this thread. Falls back to
+    // readObjectID (and calls back right away) without fence support.
+    void readObjectIDAsync(int x, int y, PickCallback callback);
+    std::future<unsigned int> readObjectIDAsync(int x, int y);
+
+    // Deliver the reads whose fence has passed, in the order they were
+    // queued; wait blocks until all of them are done, but after a one
+    // second timeout delivers the unfinished ones as 0. Returns how many
+    // were delivered.
+    unsigned int pollPicks(bool wait = false);
+    bool hasPendingPicks() const { return !m_pending.empty(); }
+
+    // Pixel buffer objects with fence sync (GL 3.2 or ARB_sync)
+    static bool supportsAsyncRead();
     
     // Convert an object ID to an RGB color for rendering
     static void objectIDToColor(unsigned int id, float color[3]);
@@ -48,6 +75,19 @@ private:
     void cleanup();
     
     GLuint m_fbo;              // Framebuffer object
+
+    struct PendingPick
+    {
+        GLuint pbo = 0;
+        GLsync fence = 0;
+        PickCallback callback;
+    };
+
+    // Reads in flight, oldest first, and pixel buffers free for reuse; one
+    // buffer per read, so hover picks never wait for a buffer
+    std::deque<PendingPick> m_pending;
+    std::vector<GLuint> m_freePbos;
+    std::vector<GLuint> m_pbos;
     
     int m_width;
     int m_height;
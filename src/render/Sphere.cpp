@@ -3,16 +3,27 @@
 #include <cmath>
 #include <GL/glew.h>
 #include "../gl/Shader.h"
+#include "ThreadPool.h"
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
 
 
 static const double PI = 3.14159265358979323846;
 
-Sphere::Sphere(const std::string& name, double radius, int slices, int stacks)
+// Allowed silhouette error of a coarser level, in pixels
+static const double LOD_PIXEL_ERROR = 0.5;
+
+Sphere::Sphere(const std::string& name, double radius, int slices, int stacks, bool procedural)
     : RenderObject(name)
     , m_radius(radius)
     , m_slices(slices)
     , m_stacks(stacks)
+    , m_procedural(procedural)
 {
     Build(radius, slices, stacks);
 }
@@ -23,154 +34,355 @@ Sphere::~Sphere()
 
 void Sphere::Build(double radius, int slices, int stacks)
 {
-    m_vertices.clear();
-    m_normals.clear();
-    m_colors.clear();
+    m_radius = radius;
+    m_slices = slices;
+    m_stacks = stacks;
+
+    // Procedural spheres keep only the level switch sizes, no vertices
+    if (isProcedural())
+        m_mesh.clear();
+    else
+        BuildMesh(m_mesh, radius, slices, stacks);
+    invalidateMesh();
+
+    // Halve the tessellation per level. A level with s slices deviates from
+    // the true silhouette by r * (1 - cos(pi / s)); it is used once that
+    // error is below LOD_PIXEL_ERROR pixels at the projected diameter.
+    clearLods();
+    int levelSlices = std::max(slices, 3) / 2;
+    int levelStacks = std::max(stacks, 2) / 2;
+    while (levelSlices >= 4)
+    {
+        MeshBuffer lod;
+        if (!isProcedural())
+            BuildMesh(lod, radius, levelSlices, std::max(levelStacks, 2));
+        addLod(lod, 2.0 * LOD_PIXEL_ERROR / (1.0 - cos(PI / levelSlices)));
+
+        levelSlices /= 2;
+        levelStacks /= 2;
+    }
+
+    // A single color for the whole sphere; stored as a constant attribute rather than per vertex
+    m_color = PointDouble3D(0.8, 0.2, 0.2);
+
+    invalidateBounds();
+}
+
+namespace
+{
+    // sin/cos of every ring and every column, shared by all spheres with
+    // the same tessellation
+    struct TrigTable
+    {
+        std::vector<double> ringY;    // sin(phi) per stack row
+        std::vector<double> ringR;    // cos(phi) per stack row
+        std::vector<double> cosTheta; // per column
+        std::vector<double> sinTheta;
+    };
+
+    std::shared_ptr<const TrigTable> getTrigTable(int slices, int stacks)
+    {
+        static std::mutex mutex;
+        static std::map<std::pair<int, int>, std::shared_ptr<const TrigTable>> tables;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<const TrigTable>& entry = tables[std::make_pair(slices, stacks)];
+        if (!entry)
+        {
+            std::shared_ptr<TrigTable> table = std::make_shared<TrigTable>();
+            table->ringY.resize(stacks + 1);
+            table->ringR.resize(stacks + 1);
+            for (int i = 0; i <= stacks; ++i)
+            {
+                double phi = PI * (double(i) / stacks - 0.5);
+                table->ringY[i] = sin(phi);
+                table->ringR[i] = cos(phi);
+            }
+
+            table->cosTheta.resize(slices + 1);
+            table->sinTheta.resize(slices + 1);
+            for (int j = 0; j <= slices; ++j)
+            {
+                double theta = 2.0 * PI * double(j) / slices;
+                table->cosTheta[j] = cos(theta);
+                table->sinTheta[j] = sin(theta);
+            }
+            entry = table;
+        }
+        return entry;
+    }
+
+    // Spheres below this many vertices are generated on the calling thread
+    const size_t PARALLEL_MIN_VERTICES = 16384;
+
+    // Reference generator with the trigonometry inside the loops and one
+    // push_back per attribute, kept to measure BuildMesh against
+    void buildMeshPerVertex(MeshBuffer& mesh, double radius, int slices, int stacks)
+    {
+        mesh.clear();
+        for (int i = 0; i <= stacks; ++i)
+        {
+            double phi = PI * (double(i) / stacks - 0.5);
+            for (int j = 0; j <= slices; ++j)
+            {
+                double theta = 2.0 * PI * double(j) / slices;
+                double x = cos(phi) * cos(theta);
+                double y = sin(phi);
+                double z = cos(phi) * sin(theta);
+                mesh.addPosition((float)(x * radius), (float)(y * radius), (float)(z * radius));
+                mesh.addNormal((float)x, (float)y, (float)z);
+            }
+        }
+
+        unsigned int ringSize = (unsigned int)(slices + 1);
+        for (int i = 0; i < stacks; ++i)
+        {
+            for (int j = 0; j < slices; ++j)
+            {
+                unsigned int i0 = i * ringSize + j;
+                unsigned int i1 = (i + 1) * ringSize + j;
+                mesh.addTriangle(i0, i0 + 1, i1);
+                mesh.addTriangle(i0 + 1, i1 + 1, i1);
+            }
+        }
+    }
+}
+
+void Sphere::BuildMesh(MeshBuffer& mesh, double radius, int slices, int stacks, bool parallel)
+{
+    mesh.clear();
 
     if (slices < 3) slices = 3;
     if (stacks < 2) stacks = 2;
 
-    // Generate vertices using latitude/longitude (stacks/slices)
-    for (int i = 0; i < stacks; ++i)
-    {
-        double phi1 = PI * (double(i) / stacks - 0.5);
-        double phi2 = PI * (double(i + 1) / stacks - 0.5);
+    // A (stacks + 1) x (slices + 1) grid of vertices using latitude/longitude.
+    // The seam column (j == slices) duplicates j == 0 so each ring stays a simple strip.
+    std::shared_ptr<const TrigTable> table = getTrigTable(slices, stacks);
 
-        double y1 = sin(phi1);
-        double y2 = sin(phi2);
+    unsigned int ringSize = (unsigned int)(slices + 1);
+    size_t vertexCount = (size_t)(stacks + 1) * ringSize;
+    mesh.resize(vertexCount, true, false, false);
+    std::vector<unsigned int>& indices = mesh.indices();
+    indices.resize((size_t)stacks * slices * 6);
 
-        double r1 = cos(phi1);
-        double r2 = cos(phi2);
+    float* positions = mesh.positions();
+    float* normals = mesh.normals();
+    unsigned int* out = indices.data();
 
+    // Row i writes its own vertices and the two triangles per quad between
+    // ring i and ring i + 1, so rows are independent of each other
+    auto buildRow = [&](size_t row)
+    {
+        int i = (int)row;
+        double y = table->ringY[i];
+        double r = table->ringR[i];
+
+        float* p = positions + (size_t)i * ringSize * 3;
+        float* n = normals + (size_t)i * ringSize * 3;
         for (int j = 0; j <= slices; ++j)
         {
-            double theta = 2.0 * PI * double(j) / slices;
-            double x1 = r1 * cos(theta);
-            double z1 = r1 * sin(theta);
+            double x = r * table->cosTheta[j];
+            double z = r * table->sinTheta[j];
 
-            double x2 = r2 * cos(theta);
-            double z2 = r2 * sin(theta);
+            p[0] = (float)(x * radius); p[1] = (float)(y * radius); p[2] = (float)(z * radius);
+            n[0] = (float)x; n[1] = (float)y; n[2] = (float)z;
+            p += 3;
+            n += 3;
+        }
 
-            // First vertex (phi1, theta)
-            PointDouble3D v1(x1 * radius, y1 * radius, z1 * radius);
-            PointDouble3D n1(x1, y1, z1);
+        if (i == stacks)
+            return;
 
-            // Second vertex (phi2, theta)
-            PointDouble3D v2(x2 * radius, y2 * radius, z2 * radius);
-            PointDouble3D n2(x2, y2, z2);
+        unsigned int* t = out + (size_t)i * slices * 6;
+        for (int j = 0; j < slices; ++j)
+        {
+            unsigned int i0 = i * ringSize + j;       // (phi1, theta1)
+            unsigned int i1 = (i + 1) * ringSize + j; // (phi2, theta1)
+            unsigned int i2 = i0 + 1;                 // (phi1, theta2)
+            unsigned int i3 = i1 + 1;                 // (phi2, theta2)
 
-            // For triangle strip style, we add vertices in pairs; RenderObject::Render expects triangles,
-            // so we'll push triangles below when iterating quads. For simplicity, store strip vertices now.
-            m_vertices.push_back(v1);
-            m_normals.push_back(n1);
+            // triangle 1: v0, v2, v1; triangle 2: v2, v3, v1
+            t[0] = i0; t[1] = i2; t[2] = i1;
+            t[3] = i2; t[4] = i3; t[5] = i1;
+            t += 6;
+        }
+    };
 
-            m_vertices.push_back(v2);
-            m_normals.push_back(n2);
+    if (parallel && vertexCount >= PARALLEL_MIN_VERTICES)
+    {
+        ThreadPool::global().parallelFor(0, (size_t)stacks + 1, buildRow);
+    }
+    else
+    {
+        for (int i = 0; i <= stacks; ++i)
+        {
+            buildRow(i);
         }
     }
+}
 
-    // Convert triangle-strip-like storage into triangles for RenderObject (which draws triangles sequentially)
-    // Current storage has pairs [v1,v2] repeated; we need to form triangles from adjacent pairs.
-    std::vector<PointDouble3D> triVerts;
-    std::vector<PointDouble3D> triNormals;
-    std::vector<PointDouble3D> triColors;
+void Sphere::benchmarkBuild(unsigned int count, int slices, int stacks)
+{
+    double checksum = 0.0;
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
 
-    int vertsPerStack = (slices + 1) * 2;
-    for (int s = 0; s < stacks; ++s)
+    auto run = [&](int variant) -> double
     {
-        int base = s * vertsPerStack;
-        for (int j = 0; j < slices; ++j)
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int k = 0; k < count; ++k)
+        {
+            // A new mesh per sphere, as when loading a scene
+            MeshBuffer mesh;
+            if (variant == 0)
+                buildMeshPerVertex(mesh, 1.0, slices, stacks);
+            else
+                BuildMesh(mesh, 1.0, slices, stacks, variant == 2);
+            checksum += mesh.positions()[3 * (k % mesh.vertexCount())];
+            vertexCount = mesh.vertexCount();
+            triangleCount = mesh.triangleCount();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    double perVertexMs = run(0);
+    double tableMs = run(1);
+    double parallelMs = run(2);
+
+    printf("Sphere::benchmarkBuild: %u spheres of %dx%d (%u vertices, %u triangles)\n",
+        count, slices, stacks, (unsigned)vertexCount, (unsigned)triangleCount);
+    printf("  per-vertex trig:   %8.2f ms\n", perVertexMs);
+    printf("  trig tables:       %8.2f ms (%.2fx)\n", tableMs, perVertexMs / tableMs);
+    printf("  tables + %2u threads: %6.2f ms (%.2fx)\n", ThreadPool::global().getThreadCount(), parallelMs, perVertexMs / parallelMs);
+    printf("  (checksum %.3f)\n", checksum);
+}
+
+void Sphere::setProcedural(bool procedural)
+{
+    if (procedural == m_procedural)
+        return;
+
+    bool wasProcedural = isProcedural();
+    m_procedural = procedural;
+    if (isProcedural() != wasProcedural)
+    {
+        cleanRenderResources();
+        Build(m_radius, m_slices, m_stacks);
+    }
+}
+
+bool Sphere::isProcedural() const
+{
+    // Vertices from gl_VertexID need the shader path
+    return m_procedural && getRenderMethod() == RENDER_VAO;
+}
+
+uint64_t Sphere::getGeometryKey() const
+{
+    // The parameters name the mesh only as long as it is the generated one
+    size_t gridVertices = (size_t)(std::max(m_stacks, 2) + 1) * (std::max(m_slices, 3) + 1);
+    if (m_mesh.hasColors() || m_mesh.hasTexCoords() || m_mesh.vertexCount() != gridVertices)
+    {
+        return RenderObject::getGeometryKey();
+    }
+
+    double params[3] = { m_radius, (double)m_slices, (double)m_stacks };
+    return GeometryCache::hashValues("Sphere", params, 3);
+}
+
+void Sphere::getLodTessellation(unsigned int level, int& slices, int& stacks) const
+{
+    slices = std::max(m_slices, 3) >> level;
+    stacks = std::max(std::max(m_stacks, 2) >> level, 2);
+}
+
+void Sphere::buildGraphicsResources()
+{
+    // The backend changed since the last Build(): a procedural sphere on a
+    // fixed-function backend needs its vertices, and gets rid of them again
+    // back on the shader path
+    if (isProcedural() != m_mesh.empty())
+    {
+        Build(m_radius, m_slices, m_stacks);
+    }
+
+    if (!isProcedural())
+    {
+        RenderObject::buildGraphicsResources();
+        return;
+    }
+
+    // Nothing to upload; core profiles still need a VAO bound to draw
+    if (m_vao == 0)
+    {
+        glGenVertexArrays(1, &m_vao);
+    }
+    m_drawCount = (GLsizei)(std::max(m_slices, 3) * std::max(m_stacks, 2) * 6);
+
+    if (s_logResources)
+    {
+        printf("Sphere::buildGraphicsResources(%s): procedural, %u vertices from gl_VertexID, 0 bytes on GPU\n",
+            m_name.c_str(),
+            (unsigned)m_drawCount);
+    }
+
+    markChanged();
+
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child)
         {
-            // indices in the strip
-            int i0 = base + j * 2;
-            int i1 = i0 + 1;
-            int i2 = i0 + 2;
-            int i3 = i0 + 3;
-
-            // triangle 1: v0, v2, v1
-            triVerts.push_back(m_vertices[i0]);
-            triVerts.push_back(m_vertices[i2]);
-            triVerts.push_back(m_vertices[i1]);
-
-            triNormals.push_back(m_normals[i0]);
-            triNormals.push_back(m_normals[i2]);
-            triNormals.push_back(m_normals[i1]);
-
-            // triangle 2: v2, v3, v1
-            triVerts.push_back(m_vertices[i2]);
-            triVerts.push_back(m_vertices[i3]);
-            triVerts.push_back(m_vertices[i1]);
-
-            triNormals.push_back(m_normals[i2]);
-            triNormals.push_back(m_normals[i3]);
-            triNormals.push_back(m_normals[i1]);
+            child->buildGraphicsResources();
         }
     }
+}
+
+void Sphere::collectDrawItems(std::vector<DrawItem>& items) const
+{
+    if (!isProcedural())
+    {
+        RenderObject::collectDrawItems(items);
+        return;
+    }
+
+    if (m_vao != 0)
+    {
+        DrawItem item = makeDrawItem();
+        applyLod(0, item);
+        items.push_back(item);
+    }
+
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child)
+        {
+            child->collectDrawItems(items);
+        }
+    }
+}
+
+void Sphere::applyLod(unsigned int level, DrawItem& item) const
+{
+    if (!isProcedural())
+    {
+        RenderObject::applyLod(level, item);
+        return;
+    }
 
-    // Replace buffers with triangle lists
-    m_vertices.swap(triVerts);
-    m_normals.swap(triNormals);
-
-    // generate a simple per-vertex color if none provided: top red -> bottom blue
-    m_colors.clear();
-    m_colors.reserve(m_vertices.size());
-    for (const auto &vv : m_vertices)
-    {
-        // double t = 0.5 * (vv.y / radius + 1.0);
-        // if (t < 0.0) t = 0.0; 
-        // if (t > 1.0) t = 1.0;
-        // m_colors.emplace_back(t, 0.0, 1.0 - t);
-        m_colors.emplace_back(0.8, 0.2, 0.2);
-    }
-
-    // Build interleaved buffer: pos(3), normal(3), color(3)
-    // std::vector<float> interleaved;
-    // interleaved.reserve(m_vertices.size() * 9);
-    // for (size_t i = 0; i < m_vertices.size(); ++i)
-    // {
-    //     const auto &p = m_vertices[i];
-    //     const auto &n = m_normals[i];
-    //     const auto &c = m_colors[i];
-    //     interleaved.push_back((float)p.x);
-    //     interleaved.push_back((float)p.y);
-    //     interleaved.push_back((float)p.z);
-    //     interleaved.push_back((float)n.x);
-    //     interleaved.push_back((float)n.y);
-    //     interleaved.push_back((float)n.z);
-    //     interleaved.push_back((float)c.x);
-    //     interleaved.push_back((float)c.y);
-    //     interleaved.push_back((float)c.z);
-    // }
-
-    // // Create VAO/VBO (requires GL context/current)
-    // if (m_vao) { glDeleteVertexArrays(1, &m_vao); m_vao = 0; }
-    // if (m_vbo) { glDeleteBuffers(1, &m_vbo); m_vbo = 0; }
-
-    // glGenVertexArrays(1, &m_vao);
-    // glBindVertexArray(m_vao);
-
-    // glGenBuffers(1, &m_vbo);
-    // glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    // glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(float), interleaved.data(), GL_STATIC_DRAW);
-
-    // GLsizei stride = 9 * sizeof(float);
-    // // position at location 0
-    // glEnableVertexAttribArray(0);
-    // glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(0));
-    // // normal at location 1
-    // glEnableVertexAttribArray(1);
-    // glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-    // // color at location 2
-    // glEnableVertexAttribArray(2);
-    // glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-
-    // glBindVertexArray(0);
-    // glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // A coarser level is just a smaller draw count
+    int slices, stacks;
+    getLodTessellation(level, slices, stacks);
+    item.shader = Shader::GetProceduralSphereShader();
+    item.vao = m_vao;
+    item.count = (GLsizei)(slices * stacks * 6);
+    item.indexType = 0;
+    item.layout = nullptr;
+    item.shapeParams = glm::vec4((float)m_radius, (float)slices, (float)stacks, 0.0f);
 }
 
-bool Sphere::getVolume(PointDouble3D& min, PointDouble3D& max) const
+bool Sphere::computeLocalVolume(PointDouble3D& min, PointDouble3D& max) const
 {
-    min = PointDouble3D(-m_radius + m_position.x, -m_radius + m_position.y, -m_radius + m_position.z);
-    max = PointDouble3D(m_radius + m_position.x, m_radius + m_position.y, m_radius + m_position.z);
+    min = PointDouble3D(-m_radius, -m_radius, -m_radius);
+    max = PointDouble3D(m_radius, m_radius, m_radius);
     return true;
 }
\ No newline at end of file
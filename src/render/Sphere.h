@@ -8,21 +8,45 @@ public:
     // radius: sphere radius
     // slices: subdivisions around the Z axis (like longitude)
     // stacks: subdivisions from top to bottom (like latitude)
-    Sphere(const std::string& name, double radius, int slices, int stacks);
+    // procedural: see setProcedural; builds no mesh on the shader path
+    Sphere(const std::string& name, double radius, int slices, int stacks, bool procedural = false);
     virtual ~Sphere();
     //virtual void Render() override;
 
+    // Indexed latitude/longitude sphere with normals. Uses sin/cos tables
+    // cached per (slices, stacks); large spheres are split by stack rows
+    // across the global ThreadPool unless parallel is false (required when
+    // called from inside a pool task).
+    static void BuildMesh(MeshBuffer& mesh, double radius, int slices, int stacks, bool parallel = true);
+
+    // Time BuildMesh against per-vertex trigonometry and print the results
+    static void benchmarkBuild(unsigned int count, int slices, int stacks);
+
+    // Procedural mode (shader path only): no vertex or index buffers, the
+    // vertex shader rebuilds every vertex from gl_VertexID, radius, slices
+    // and stacks, so a sphere costs no GPU memory. Takes effect on the next
+    // buildGraphicsResources(); needs the GL context if resources exist.
+    // Kept across backend switches, but only in effect on RENDER_VAO.
+    void setProcedural(bool procedural);
+    bool isProcedural() const;
+
+    virtual void buildGraphicsResources() override;
+    virtual void collectDrawItems(std::vector<DrawItem>& items) const override;
+    virtual void applyLod(unsigned int level, DrawItem& item) const override;
+    virtual uint64_t getGeometryKey() const override;
+
 private:
-    // Rebuild mesh with new parameters
+    // Rebuild mesh and level of detail chain with new parameters
     void Build(double radius, int slices, int stacks);
 
-    virtual bool getVolume(PointDouble3D& min, PointDouble3D& max) const;
-
 protected:
+    virtual bool computeLocalVolume(PointDouble3D& min, PointDouble3D& max) const override;
+
+    // Tessellation of a level of detail, as generated by Build()
+    void getLodTessellation(unsigned int level, int& slices, int& stacks) const;
+
     double m_radius;
     int m_slices;
     int m_stacks;
-    // GL resources for modern rendering
-    GLuint m_vao = 0;
-    GLuint m_vbo = 0; // interleaved VBO (pos,norm,color)
+    bool m_procedural = false;
 };
@@ -0,0 +1,80 @@
+#include "SphereImpostors.h"
+#include "SceneGraph.h"
+#include "Sphere.h"
+#include "../gl/Shader.h"
+#include <cstdio>
+
+
+SphereImpostors::SphereImpostors(const std::string& name)
+    : InstancedRenderObject(name)
+{
+    // Unit sphere for the bounds of every instance and the fixed-function fallback
+    MeshBuffer unitSphere;
+    Sphere::BuildMesh(unitSphere, 1.0, 12, 6);
+    setMesh(unitSphere);
+}
+
+SphereImpostors::~SphereImpostors()
+{
+}
+
+void SphereImpostors::buildGraphicsResources()
+{
+    if (getRenderMethod() != RENDER_VAO)
+    {
+        InstancedRenderObject::buildGraphicsResources();
+        return;
+    }
+
+    // No vertex data at all: the quad corners come from gl_VertexID and
+    // everything else from the per-instance attributes
+    if (m_vao == 0)
+    {
+        glGenVertexArrays(1, &m_vao);
+    }
+    m_drawCount = 6;
+    uploadInstances();
+
+    if (s_logResources)
+    {
+        printf("SphereImpostors::buildGraphicsResources(%s): %u spheres, %u bytes/sphere on GPU\n",
+            m_name.c_str(),
+            (unsigned)m_instances.size(),
+            (unsigned)instanceBytes());
+    }
+
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child)
+        {
+            child->buildGraphicsResources();
+        }
+    }
+}
+
+void SphereImpostors::collectDrawItems(std::vector<DrawItem>& items) const
+{
+    if (getRenderMethod() != RENDER_VAO)
+    {
+        InstancedRenderObject::collectDrawItems(items);
+        return;
+    }
+
+    if (m_vao != 0 && !m_instances.empty())
+    {
+        DrawItem item = makeDrawItem();
+        item.shader = Shader::GetImpostorShader();
+        item.indexType = 0;
+        item.instanceCount = (GLsizei)m_instances.size();
+        item.layout = nullptr; // no vertex decode, no constant color attribute
+        items.push_back(item);
+    }
+
+    for (const std::shared_ptr<RenderObject>& child : m_children)
+    {
+        if (child)
+        {
+            child->collectDrawItems(items);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "InstancedRenderObject.h"
+
+/**
+ * SphereImpostors draws every instance as a ray-cast sphere on a single
+ * camera facing quad: 6 vertices per sphere instead of a tessellated mesh.
+ *
+ * Instance position is the sphere center and scale its radius. The
+ * fragment shader intersects the view ray with the exact sphere and
+ * writes gl_FragDepth, the lit color and the select color, so impostors
+ * depth-test against regular geometry and can be picked like instances.
+ *
+ * Impostors need the shader path; the fixed-function render methods fall
+ * back to a coarse tessellated sphere per instance.
+ */
+class SphereImpostors : public InstancedRenderObject
+{
+public:
+    SphereImpostors(const std::string& name);
+    virtual ~SphereImpostors();
+
+    virtual void buildGraphicsResources() override;
+    virtual void collectDrawItems(std::vector<DrawItem>& items) const override;
+};
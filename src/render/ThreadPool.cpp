@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 2;
+    }
+
+    m_workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::global()
+{
+    static ThreadPool s_pool;
+    return s_pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_condition.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping && m_jobs.empty())
+                return;
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& body)
+{
+    if (begin >= end)
+        return;
+
+    // Workers and the caller pull indices from a shared counter, so uneven
+    // items (e.g. meshes of very different size) still balance out
+    std::shared_ptr<std::atomic<size_t>> next = std::make_shared<std::atomic<size_t>>(begin);
+    auto run = [next, end, &body]()
+    {
+        for (size_t i = (*next)++; i < end; i = (*next)++)
+        {
+            body(i);
+        }
+    };
+
+    size_t helpers = std::min((size_t)getThreadCount(), end - begin - 1);
+    std::vector<std::future<void>> pending;
+    pending.reserve(helpers);
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        pending.push_back(submit(run));
+    }
+
+    run();
+    for (std::future<void>& f : pending)
+    {
+        f.get();
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/**
+ * Fixed size pool of worker threads for CPU side batch work (mesh
+ * processing, geometry generation). Tasks must not touch GL state; the
+ * GL context belongs to the thread that created it.
+ */
+class ThreadPool
+{
+public:
+    // threadCount == 0 uses one thread per hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+
+    // Shared pool sized to the machine
+    static ThreadPool& global();
+
+    unsigned int getThreadCount() const { return (unsigned int)m_workers.size(); }
+
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> submit(F task)
+    {
+        typedef typename std::result_of<F()>::type Result;
+        std::shared_ptr<std::packaged_task<Result()>> packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> future = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return future;
+    }
+
+    // Run body(i) for i in [begin, end) split into chunks across the pool
+    // and wait for all of them; the calling thread works on chunks as well.
+    // Must not be called from inside a pool task.
+    void parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& body);
+
+private:
+    void enqueue(std::function<void()> job);
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+};
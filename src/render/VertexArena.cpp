@@ -0,0 +1,433 @@
+#include "VertexArena.h"
+#include "MeshBuffer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+
+// Initial capacities: 64k vertices and 1 MB of indices per arena
+static const size_t INITIAL_VERTEX_UNITS = 1 << 16;
+static const size_t INITIAL_INDEX_UNITS = 1 << 18;
+static const size_t INDEX_UNIT_BYTES = 4;
+
+std::map<int, std::unique_ptr<VertexArena>> VertexArena::s_arenas;
+unsigned int VertexArena::s_generation = 0;
+
+BuddyAllocator::BuddyAllocator(size_t capacity)
+{
+    m_maxOrder = orderFor(std::max(capacity, (size_t)1));
+    m_free.resize(m_maxOrder + 1);
+    m_free[m_maxOrder].insert(0);
+}
+
+unsigned int BuddyAllocator::orderFor(size_t units)
+{
+    unsigned int order = 0;
+    while (((size_t)1 << order) < units)
+    {
+        ++order;
+    }
+    return order;
+}
+
+bool BuddyAllocator::canAllocate(size_t units) const
+{
+    unsigned int order = orderFor(std::max(units, (size_t)1));
+    for (unsigned int k = order; k <= m_maxOrder; ++k)
+    {
+        if (!m_free[k].empty())
+            return true;
+    }
+    return false;
+}
+
+size_t BuddyAllocator::allocate(size_t units)
+{
+    unsigned int order = orderFor(std::max(units, (size_t)1));
+
+    unsigned int k = order;
+    while (k <= m_maxOrder && m_free[k].empty())
+    {
+        ++k;
+    }
+    if (k > m_maxOrder)
+        return INVALID;
+
+    // Lowest free block keeps the allocations packed towards the start
+    size_t offset = *m_free[k].begin();
+    m_free[k].erase(m_free[k].begin());
+
+    // Split down, returning the upper halves to the free lists
+    while (k > order)
+    {
+        --k;
+        m_free[k].insert(offset + ((size_t)1 << k));
+    }
+
+    m_allocated[offset] = order;
+    m_usedUnits += (size_t)1 << order;
+    return offset;
+}
+
+void BuddyAllocator::free(size_t offset)
+{
+    auto it = m_allocated.find(offset);
+    if (it == m_allocated.end())
+        return;
+
+    unsigned int order = it->second;
+    m_allocated.erase(it);
+    m_usedUnits -= (size_t)1 << order;
+    insertFree(offset, order);
+}
+
+void BuddyAllocator::insertFree(size_t offset, unsigned int order)
+{
+    // Merge with the buddy as long as it is free as a whole
+    while (order < m_maxOrder)
+    {
+        size_t buddy = offset ^ ((size_t)1 << order);
+        auto it = m_free[order].find(buddy);
+        if (it == m_free[order].end())
+            break;
+
+        m_free[order].erase(it);
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+    m_free[order].insert(offset);
+}
+
+void BuddyAllocator::grow()
+{
+    size_t oldCapacity = capacity();
+    ++m_maxOrder;
+    m_free.resize(m_maxOrder + 1);
+    insertFree(oldCapacity, m_maxOrder - 1);
+}
+
+size_t BuddyAllocator::blockSize(size_t offset) const
+{
+    auto it = m_allocated.find(offset);
+    return it != m_allocated.end() ? (size_t)1 << it->second : 0;
+}
+
+VertexArena& VertexArena::forLayout(VertexFormat format, bool hasColors)
+{
+    int key = (int)format * 2 + (hasColors ? 1 : 0);
+    std::unique_ptr<VertexArena>& arena = s_arenas[key];
+    if (!arena)
+    {
+        arena.reset(new VertexArena(format, hasColors));
+    }
+    return *arena;
+}
+
+VertexArena::VertexArena(VertexFormat format, bool hasColors)
+    : m_format(format)
+    , m_hasColors(hasColors)
+    , m_vertexAllocator(INITIAL_VERTEX_UNITS)
+    , m_indexAllocator(INITIAL_INDEX_UNITS)
+{
+}
+
+VertexArena* VertexArena::forVao(GLuint vao)
+{
+    for (auto& entry : s_arenas)
+    {
+        if (vao != 0 && entry.second->m_vao == vao)
+            return entry.second.get();
+    }
+    return nullptr;
+}
+
+bool VertexArena::compactAll()
+{
+    bool moved = false;
+    for (auto& entry : s_arenas)
+    {
+        moved |= entry.second->compact();
+    }
+    return moved;
+}
+
+void VertexArena::printStats()
+{
+    for (auto& entry : s_arenas)
+    {
+        const VertexArena& arena = *entry.second;
+        size_t ranges = arena.m_allocations.size() - arena.m_freeHandles.size();
+        printf("VertexArena(%s%s): %u ranges, %u of %u bytes used, generation %u\n",
+            vertexFormatName(arena.m_format),
+            arena.m_hasColors ? "+color" : "",
+            (unsigned)ranges,
+            (unsigned)arena.getUsedBytes(),
+            (unsigned)arena.getCapacityBytes(),
+            s_generation);
+    }
+}
+
+unsigned int VertexArena::allocate(const MeshBuffer& mesh, VertexLayout& layout)
+{
+    if (mesh.empty())
+        return 0;
+
+    std::vector<unsigned char> vertices;
+    layout = encodeVertices(mesh, m_format, vertices);
+
+    if (m_vao == 0)
+    {
+        // Every mesh of this arena shares the attribute layout of the first
+        m_layout = layout;
+        glGenVertexArrays(1, &m_vao);
+        growBuffers();
+    }
+
+    // 16-bit indices where the mesh allows it; base vertex offsets keep them valid
+    std::vector<unsigned char> indices;
+    if (mesh.isIndexed())
+    {
+        const std::vector<unsigned int>& source = mesh.indices();
+        if (mesh.indexType() == GL_UNSIGNED_SHORT)
+        {
+            std::vector<unsigned short> shortIndices(source.begin(), source.end());
+            indices.resize(shortIndices.size() * sizeof(unsigned short));
+            memcpy(indices.data(), shortIndices.data(), indices.size());
+        }
+        else
+        {
+            indices.resize(source.size() * sizeof(unsigned int));
+            memcpy(indices.data(), source.data(), indices.size());
+        }
+    }
+
+    size_t vertexUnits = mesh.vertexCount();
+    size_t indexUnits = (indices.size() + INDEX_UNIT_BYTES - 1) / INDEX_UNIT_BYTES;
+    reserve(vertexUnits, indexUnits);
+
+    Allocation allocation;
+    allocation.vertexUnits = vertexUnits;
+    allocation.indexUnits = indexUnits;
+    allocation.live = true;
+    allocation.range.baseVertex = (GLint)m_vertexAllocator.allocate(vertexUnits);
+    allocation.range.vertexCount = vertexUnits;
+    allocation.range.indexOffset = indexUnits > 0 ? m_indexAllocator.allocate(indexUnits) * INDEX_UNIT_BYTES : 0;
+    allocation.range.indexBytes = indices.size();
+
+    // Upload through the copy target so the VAO's element binding is untouched
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)allocation.range.baseVertex * m_layout.stride, vertices.size(), vertices.data());
+    if (!indices.empty())
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_ibo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)allocation.range.indexOffset, indices.size(), indices.data());
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    unsigned int handle;
+    if (!m_freeHandles.empty())
+    {
+        handle = m_freeHandles.back();
+        m_freeHandles.pop_back();
+        m_allocations[handle - 1] = allocation;
+    }
+    else
+    {
+        m_allocations.push_back(allocation);
+        handle = (unsigned int)m_allocations.size();
+    }
+    return handle;
+}
+
+void VertexArena::free(unsigned int handle)
+{
+    if (handle == 0 || handle > m_allocations.size() || !m_allocations[handle - 1].live)
+        return;
+
+    Allocation& allocation = m_allocations[handle - 1];
+    m_vertexAllocator.free((size_t)allocation.range.baseVertex);
+    if (allocation.indexUnits > 0)
+    {
+        m_indexAllocator.free(allocation.range.indexOffset / INDEX_UNIT_BYTES);
+    }
+    allocation.live = false;
+    m_freeHandles.push_back(handle);
+}
+
+void VertexArena::reserve(size_t vertexUnits, size_t indexUnits)
+{
+    bool compacted = false;
+    for (;;)
+    {
+        bool vertexFits = m_vertexAllocator.canAllocate(vertexUnits);
+        bool indexFits = indexUnits == 0 || m_indexAllocator.canAllocate(indexUnits);
+        if (vertexFits && indexFits)
+            return;
+
+        // Mostly free but fragmented: repacking is cheaper than growing
+        bool sparse = (!vertexFits && m_vertexAllocator.usedUnits() + vertexUnits <= m_vertexAllocator.capacity() / 2) ||
+                      (!indexFits && m_indexAllocator.usedUnits() + indexUnits <= m_indexAllocator.capacity() / 2);
+        if (sparse && !compacted)
+        {
+            compact();
+            compacted = true;
+            continue;
+        }
+
+        if (!vertexFits)
+            m_vertexAllocator.grow();
+        if (!indexFits)
+            m_indexAllocator.grow();
+        growBuffers();
+    }
+}
+
+void VertexArena::growBuffers()
+{
+    size_t vertexBytes = m_vertexAllocator.capacity() * m_layout.stride;
+    size_t indexBytes = m_indexAllocator.capacity() * INDEX_UNIT_BYTES;
+
+    GLuint buffers[2] = { 0, 0 };
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+    glBufferData(GL_COPY_WRITE_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+    glBufferData(GL_COPY_WRITE_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+
+    // Offsets are unchanged, so the old contents are copied as a whole
+    GLint oldSize = 0;
+    if (m_vbo != 0)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &oldSize);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, std::min((size_t)oldSize, vertexBytes));
+        glDeleteBuffers(1, &m_vbo);
+    }
+    if (m_ibo != 0)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_ibo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &oldSize);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, std::min((size_t)oldSize, indexBytes));
+        glDeleteBuffers(1, &m_ibo);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    m_vbo = buffers[0];
+    m_ibo = buffers[1];
+    bindVao();
+}
+
+void VertexArena::bindVao()
+{
+    // The VAO name stays the same, so draw items referring to it stay valid
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    setupVertexAttributes(m_layout);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool VertexArena::compact()
+{
+    if (m_vao == 0)
+        return false;
+
+    // Largest first into empty allocators packs the blocks without holes
+    std::vector<unsigned int> order;
+    for (size_t i = 0; i < m_allocations.size(); ++i)
+    {
+        if (m_allocations[i].live)
+            order.push_back((unsigned int)i);
+    }
+
+    BuddyAllocator vertexAllocator(m_vertexAllocator.capacity());
+    BuddyAllocator indexAllocator(m_indexAllocator.capacity());
+    std::vector<Range> ranges(m_allocations.size());
+    bool moved = false;
+
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b)
+    {
+        return m_allocations[a].vertexUnits > m_allocations[b].vertexUnits;
+    });
+    for (unsigned int i : order)
+    {
+        ranges[i] = m_allocations[i].range;
+        ranges[i].baseVertex = (GLint)vertexAllocator.allocate(m_allocations[i].vertexUnits);
+        moved |= ranges[i].baseVertex != m_allocations[i].range.baseVertex;
+    }
+
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b)
+    {
+        return m_allocations[a].indexUnits > m_allocations[b].indexUnits;
+    });
+    for (unsigned int i : order)
+    {
+        if (m_allocations[i].indexUnits == 0)
+            continue;
+        ranges[i].indexOffset = indexAllocator.allocate(m_allocations[i].indexUnits) * INDEX_UNIT_BYTES;
+        moved |= ranges[i].indexOffset != m_allocations[i].range.indexOffset;
+    }
+
+    if (!moved)
+        return false;
+
+    GLuint buffers[2] = { 0, 0 };
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+    glBufferData(GL_COPY_WRITE_BUFFER, vertexAllocator.capacity() * m_layout.stride, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+    glBufferData(GL_COPY_WRITE_BUFFER, indexAllocator.capacity() * INDEX_UNIT_BYTES, nullptr, GL_STATIC_DRAW);
+
+    for (unsigned int i : order)
+    {
+        const Range& from = m_allocations[i].range;
+        const Range& to = ranges[i];
+
+        glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            (GLintptr)from.baseVertex * m_layout.stride, (GLintptr)to.baseVertex * m_layout.stride, from.vertexCount * m_layout.stride);
+
+        if (from.indexBytes > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, m_ibo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from.indexOffset, to.indexOffset, from.indexBytes);
+        }
+
+        m_allocations[i].range = to;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &m_vbo);
+    glDeleteBuffers(1, &m_ibo);
+    m_vbo = buffers[0];
+    m_ibo = buffers[1];
+    m_vertexAllocator = vertexAllocator;
+    m_indexAllocator = indexAllocator;
+    bindVao();
+
+    ++s_generation;
+    return true;
+}
+
+size_t VertexArena::getCapacityBytes() const
+{
+    return m_vertexAllocator.capacity() * m_layout.stride + m_indexAllocator.capacity() * INDEX_UNIT_BYTES;
+}
+
+size_t VertexArena::getUsedBytes() const
+{
+    size_t bytes = 0;
+    for (const Allocation& allocation : m_allocations)
+    {
+        if (allocation.live)
+            bytes += allocation.range.vertexCount * m_layout.stride + allocation.range.indexBytes;
+    }
+    return bytes;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <GL/glew.h>
+
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include "VertexFormat.h"
+
+/**
+ * Binary buddy allocator over an abstract range of units. Blocks are
+ * powers of two, so a request wastes at most half its block, but freeing
+ * merges neighbours back in O(log n) and the state stays trivially valid
+ * when the range doubles.
+ */
+class BuddyAllocator
+{
+public:
+    static const size_t INVALID = ~(size_t)0;
+
+    // capacity is rounded up to a power of two
+    explicit BuddyAllocator(size_t capacity = 0);
+
+    // Offset of a block of at least units units, or INVALID when full
+    size_t allocate(size_t units);
+    bool canAllocate(size_t units) const;
+    void free(size_t offset);
+
+    // Double the capacity; existing blocks keep their offsets
+    void grow();
+
+    size_t capacity() const { return (size_t)1 << m_maxOrder; }
+    size_t usedUnits() const { return m_usedUnits; }
+    size_t blockSize(size_t offset) const;
+
+private:
+    static unsigned int orderFor(size_t units);
+    void insertFree(size_t offset, unsigned int order);
+
+    unsigned int m_maxOrder = 0;
+    std::vector<std::set<size_t>> m_free;               // free block offsets per order
+    std::unordered_map<size_t, unsigned int> m_allocated; // offset -> order
+    size_t m_usedUnits = 0;
+};
+
+/**
+ * VertexArena packs the meshes of one vertex layout into a single vertex
+ * buffer and a single index buffer, drawn through one shared VAO with
+ * base-vertex offsets. Objects then differ only in their draw parameters,
+ * so the render queue no longer rebinds buffers between them.
+ *
+ * Ranges are suballocated with a BuddyAllocator (vertices in units of the
+ * stride, indices in units of 4 bytes). A full arena is compacted when it
+ * is mostly free and grown by doubling otherwise; growing keeps offsets,
+ * compaction moves them and bumps getGeneration() so cached draw items are
+ * rebuilt. All functions need the GL context current.
+ */
+class VertexArena
+{
+public:
+    struct Range
+    {
+        GLint baseVertex = 0;
+        size_t vertexCount = 0;
+        size_t indexOffset = 0; // in bytes
+        size_t indexBytes = 0;
+    };
+
+    // The arena for meshes encoded in format, with or without a color array
+    static VertexArena& forLayout(VertexFormat format, bool hasColors);
+
+    // The arena whose shared VAO is vao, or nullptr
+    static VertexArena* forVao(GLuint vao);
+
+    // Compact every arena; returns true when any data moved
+    static bool compactAll();
+
+    // Incremented whenever ranges move
+    static unsigned int getGeneration() { return s_generation; }
+
+    static void printStats();
+
+    // Encode and upload mesh; returns a handle (0 on failure) and the layout
+    // with the mesh's decode parameters
+    unsigned int allocate(const MeshBuffer& mesh, VertexLayout& layout);
+    void free(unsigned int handle);
+
+    const Range& getRange(unsigned int handle) const { return m_allocations[handle - 1].range; }
+    GLuint getVao() const { return m_vao; }
+
+    // Current buffers, for VAOs of other passes; they change when the arena grows or compacts
+    GLuint getVertexBuffer() const { return m_vbo; }
+    GLuint getIndexBuffer() const { return m_ibo; }
+    const VertexLayout& getLayout() const { return m_layout; }
+
+    // Repack all live ranges from offset 0; returns true when anything moved
+    bool compact();
+
+    size_t getCapacityBytes() const;
+    size_t getUsedBytes() const;
+
+private:
+    VertexArena(VertexFormat format, bool hasColors);
+
+    struct Allocation
+    {
+        Range range;
+        size_t vertexUnits = 0; // size of the buddy blocks
+        size_t indexUnits = 0;
+        bool live = false;
+    };
+
+    // Make room for the given units, compacting or growing as needed
+    void reserve(size_t vertexUnits, size_t indexUnits);
+    // Move the contents into buffers of the allocators' current capacities
+    void growBuffers();
+    void bindVao();
+
+    VertexFormat m_format;
+    bool m_hasColors;
+    VertexLayout m_layout; // attribute layout shared by every range
+    GLuint m_vbo = 0;
+    GLuint m_ibo = 0;
+    GLuint m_vao = 0;
+
+    BuddyAllocator m_vertexAllocator;
+    BuddyAllocator m_indexAllocator;
+    std::vector<Allocation> m_allocations; // handle - 1
+    std::vector<unsigned int> m_freeHandles;
+
+    static std::map<int, std::unique_ptr<VertexArena>> s_arenas;
+    static unsigned int s_generation;
+};
@@ -0,0 +1,222 @@
+#include "VertexFormat.h"
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+
+static float signNotZero(float v)
+{
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+void octEncode(const float n[3], float out[2])
+{
+    float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    if (l1 <= 0.0f)
+    {
+        out[0] = 0.0f;
+        out[1] = 0.0f;
+        return;
+    }
+
+    float x = n[0] / l1;
+    float y = n[1] / l1;
+    if (n[2] < 0.0f)
+    {
+        // fold the lower hemisphere over the diagonals
+        float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+        float fy = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+    out[0] = x;
+    out[1] = y;
+}
+
+void octDecode(const float e[2], float n[3])
+{
+    float x = e[0];
+    float y = e[1];
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+    if (z < 0.0f)
+    {
+        float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+        float fy = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+    float len = std::sqrt(x * x + y * y + z * z);
+    n[0] = x / len;
+    n[1] = y / len;
+    n[2] = z / len;
+}
+
+static int quantizeSigned(float v, int maxValue)
+{
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    return (int)std::floor(v * maxValue + 0.5f);
+}
+
+static unsigned char quantizeUnorm8(float v)
+{
+    if (v > 1.0f) v = 1.0f;
+    if (v < 0.0f) v = 0.0f;
+    return (unsigned char)std::floor(v * 255.0f + 0.5f);
+}
+
+static void writeShort(unsigned char* dst, int v)
+{
+    int16_t s = (int16_t)v;
+    std::memcpy(dst, &s, sizeof(s));
+}
+
+static VertexLayout makeLayout(VertexFormat format, bool hasColors)
+{
+    VertexLayout layout;
+    layout.format = format;
+    layout.hasColors = hasColors;
+
+    switch (format)
+    {
+    case VERTEX_FORMAT_COMPACT16:
+        layout.positionType = GL_SHORT;  layout.positionSize = 3; layout.positionOffset = 0;
+        layout.normalType = GL_SHORT;    layout.normalSize = 2;   layout.normalOffset = 8;
+        layout.colorType = GL_UNSIGNED_BYTE; layout.colorSize = 4; layout.colorOffset = 12;
+        layout.stride = hasColors ? 16 : 12;
+        layout.normalScale = 1.0f / 32767.0f;
+        layout.octNormals = true;
+        break;
+    case VERTEX_FORMAT_COMPACT16_OCT8:
+        layout.positionType = GL_SHORT;  layout.positionSize = 3; layout.positionOffset = 0;
+        layout.normalType = GL_BYTE;     layout.normalSize = 2;   layout.normalOffset = 6;
+        layout.colorType = GL_UNSIGNED_BYTE; layout.colorSize = 4; layout.colorOffset = 8;
+        layout.stride = hasColors ? 12 : 8;
+        layout.normalScale = 1.0f / 127.0f;
+        layout.octNormals = true;
+        break;
+    case VERTEX_FORMAT_FLOAT:
+    default:
+        layout.format = VERTEX_FORMAT_FLOAT;
+        layout.positionType = GL_FLOAT;  layout.positionSize = 3; layout.positionOffset = 0;
+        layout.normalType = GL_FLOAT;    layout.normalSize = 3;   layout.normalOffset = 3 * sizeof(float);
+        layout.colorType = GL_FLOAT;     layout.colorSize = 3;    layout.colorOffset = 6 * sizeof(float);
+        layout.stride = (GLsizei)((hasColors ? 9 : 6) * sizeof(float));
+        break;
+    }
+    return layout;
+}
+
+VertexLayout encodeVertices(const MeshBuffer& mesh, VertexFormat format, std::vector<unsigned char>& out)
+{
+    bool hasColors = mesh.hasColors();
+    VertexLayout layout = makeLayout(format, hasColors);
+
+    size_t vertexCount = mesh.vertexCount();
+    out.assign(vertexCount * layout.stride, 0);
+
+    const float* positions = mesh.positions();
+    const float* normals = mesh.normals();
+    const float* colors = mesh.colors();
+
+    if (layout.format == VERTEX_FORMAT_FLOAT)
+    {
+        unsigned char* dst = out.data();
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            std::memcpy(dst + layout.positionOffset, positions + i * 3, 3 * sizeof(float));
+            std::memcpy(dst + layout.normalOffset, normals + i * 3, 3 * sizeof(float));
+            if (hasColors)
+            {
+                std::memcpy(dst + layout.colorOffset, colors + i * 3, 3 * sizeof(float));
+            }
+            dst += layout.stride;
+        }
+        return layout;
+    }
+
+    // Positions are stored relative to the bounds center, scaled per axis to
+    // fill the 16-bit range; the shader undoes this with posScale/posOffset
+    PointDouble3D min, max;
+    if (mesh.getBounds(min, max))
+    {
+        double center[3] = { 0.5 * (min.x + max.x), 0.5 * (min.y + max.y), 0.5 * (min.z + max.z) };
+        double extent[3] = { 0.5 * (max.x - min.x), 0.5 * (max.y - min.y), 0.5 * (max.z - min.z) };
+        for (int k = 0; k < 3; ++k)
+        {
+            if (extent[k] <= 0.0) extent[k] = 1.0;
+            layout.posOffset[k] = (float)center[k];
+            layout.posScale[k] = (float)(extent[k] / 32767.0);
+        }
+    }
+
+    int normalMax = layout.normalType == GL_BYTE ? 127 : 32767;
+
+    unsigned char* dst = out.data();
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            float unit = (positions[i * 3 + k] - layout.posOffset[k]) / (layout.posScale[k] * 32767.0f);
+            writeShort(dst + layout.positionOffset + k * 2, quantizeSigned(unit, 32767));
+        }
+
+        float oct[2];
+        octEncode(normals + i * 3, oct);
+        if (layout.normalType == GL_BYTE)
+        {
+            dst[layout.normalOffset + 0] = (unsigned char)(signed char)quantizeSigned(oct[0], normalMax);
+            dst[layout.normalOffset + 1] = (unsigned char)(signed char)quantizeSigned(oct[1], normalMax);
+        }
+        else
+        {
+            writeShort(dst + layout.normalOffset + 0, quantizeSigned(oct[0], normalMax));
+            writeShort(dst + layout.normalOffset + 2, quantizeSigned(oct[1], normalMax));
+        }
+
+        if (hasColors)
+        {
+            dst[layout.colorOffset + 0] = quantizeUnorm8(colors[i * 3 + 0]);
+            dst[layout.colorOffset + 1] = quantizeUnorm8(colors[i * 3 + 1]);
+            dst[layout.colorOffset + 2] = quantizeUnorm8(colors[i * 3 + 2]);
+            dst[layout.colorOffset + 3] = 255;
+        }
+        dst += layout.stride;
+    }
+
+    return layout;
+}
+
+void setupVertexAttributes(const VertexLayout& layout)
+{
+    // Integer positions and normals are passed unnormalized and scaled in the
+    // shader, which keeps decoding identical across GL versions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, layout.positionSize, layout.positionType, GL_FALSE, layout.stride, (void*)layout.positionOffset);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, layout.normalSize, layout.normalType, GL_FALSE, layout.stride, (void*)layout.normalOffset);
+
+    // color at location 2; left disabled for a constant color
+    if (layout.hasColors)
+    {
+        GLboolean normalized = layout.colorType == GL_FLOAT ? GL_FALSE : GL_TRUE;
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, layout.colorSize, layout.colorType, normalized, layout.stride, (void*)layout.colorOffset);
+    }
+    else
+    {
+        glDisableVertexAttribArray(2);
+    }
+}
+
+const char* vertexFormatName(VertexFormat format)
+{
+    switch (format)
+    {
+    case VERTEX_FORMAT_COMPACT16: return "compact16";
+    case VERTEX_FORMAT_COMPACT16_OCT8: return "compact16-oct8";
+    case VERTEX_FORMAT_FLOAT:
+    default: return "float";
+    }
+}
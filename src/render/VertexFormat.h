@@ -0,0 +1,66 @@
+#pragma once
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <vector>
+#include "MeshBuffer.h"
+
+/**
+ * Interleaved vertex layouts used for GPU upload.
+ *
+ * The compact formats trade precision for bandwidth: positions are stored as
+ * 16-bit integers relative to the mesh bounds (decoded with posScale/posOffset
+ * in the vertex shader), normals are octahedral encoded into two components
+ * and colors are unorm8. They are only understood by the shader based (VAO)
+ * render path; fixed-function paths always use VERTEX_FORMAT_FLOAT.
+ *
+ * Positions keep 1/65535 of the mesh extent per axis, so the compact formats
+ * suit meshes whose detail is large relative to their size; objects opt in
+ * with RenderObject::setVertexFormat.
+ */
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT,          // float3 position, float3 normal [, float3 color]: 24/36 bytes
+    VERTEX_FORMAT_COMPACT16,      // snorm16x4 position, oct snorm16x2 normal [, unorm8x4 color]: 12/16 bytes
+    VERTEX_FORMAT_COMPACT16_OCT8  // snorm16x3 position, oct snorm8x2 normal [, unorm8x4 color]: 8/12 bytes
+};
+
+struct VertexLayout
+{
+    VertexFormat format = VERTEX_FORMAT_FLOAT;
+    GLsizei stride = 0;
+
+    GLenum positionType = GL_FLOAT;
+    GLint positionSize = 3;
+    size_t positionOffset = 0;
+
+    GLenum normalType = GL_FLOAT;
+    GLint normalSize = 3;
+    size_t normalOffset = 0;
+
+    bool hasColors = false;
+    GLenum colorType = GL_FLOAT;
+    GLint colorSize = 3;
+    size_t colorOffset = 0;
+
+    // Shader decode parameters: position = aPos * posScale + posOffset,
+    // normal = octNormals ? octDecode(aNormal.xy * normalScale) : aNormal
+    float posScale[3] = { 1.0f, 1.0f, 1.0f };
+    float posOffset[3] = { 0.0f, 0.0f, 0.0f };
+    float normalScale = 1.0f;
+    bool octNormals = false;
+};
+
+// Encode the mesh into an interleaved byte buffer using the given format.
+// Normals must be present. Returns the layout describing the buffer.
+VertexLayout encodeVertices(const MeshBuffer& mesh, VertexFormat format, std::vector<unsigned char>& out);
+
+// Enable and point the generic attributes 0 (position), 1 (normal) and 2 (color)
+// at the currently bound GL_ARRAY_BUFFER. Must be called with a VAO bound.
+void setupVertexAttributes(const VertexLayout& layout);
+
+// Octahedral normal encoding into [-1, 1]^2
+void octEncode(const float n[3], float out[2]);
+void octDecode(const float e[2], float n[3]);
+
+const char* vertexFormatName(VertexFormat format);